@@ -0,0 +1,821 @@
+#include "../include/val.hpp"
+#include "../include/val_atomic.hpp"
+#include "../include/val_batch.hpp"
+#include "../include/val_cow.hpp"
+#include "../include/val_function.hpp"
+#include "../include/val_iface.hpp"
+#include "../include/val_parallel.hpp"
+#include "../include/val_snapshot.hpp"
+#include "../include/val_vector.hpp"
+#include "../test/allocation_counter.hpp"
+
+#include "benchmark/benchmark.h"
+
+#include <any>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace {
+
+	struct base1 {
+		base1() : value1(1) {}
+		virtual ~base1() = default;
+		int32_t value1;
+	};
+
+	struct derived1 : base1 {
+		derived1() : value2(2) {}
+		int32_t value2;
+	};
+
+	// a second base, so that upcasts to it have a non-zero offset
+	struct base2 {
+		virtual ~base2() = default;
+		int64_t value3 = 3;
+	};
+
+	// a payload of exactly Size bytes
+	template <size_t Size>
+	struct payload : base1, base2 {
+		int8_t bytes[Size - sizeof(base1) - sizeof(base2)] = {};
+	};
+
+	// the small storage size used by the val benchmarks, so that small_payload fits and large_payload does not
+	constexpr size_t storage_size = 64;
+	typedef payload<48> small_payload;
+	typedef payload<256> large_payload;
+
+	static_assert(sizeof(small_payload) <= storage_size, "small_payload must fit in small storage");
+	static_assert(sizeof(large_payload) > storage_size, "large_payload must not fit in small storage");
+
+	typedef val<base1, storage_size> bench_val;
+	typedef val_unique<base1, storage_size> bench_val_unique;
+
+	// reports the global allocations per iteration made since construction
+	class allocation_report {
+	public:
+		explicit allocation_report(benchmark::State & state) : state(state) {}
+
+		~allocation_report() {
+			state.counters["allocs"] = benchmark::Counter(static_cast<double>(scope.allocations()), benchmark::Counter::kAvgIterations);
+		}
+
+	private:
+		benchmark::State & state;
+		test_support::allocation_scope scope;
+	};
+
+	constexpr int64_t batch_size = 256;
+
+}
+
+// the payloads are polymorphic, so they must be flagged for assignment between vals to reuse the object
+template <size_t Size>
+struct val_assign_in_place<payload<Size>> : std::true_type {};
+
+// construction and destruction
+
+template <typename Payload>
+static void construct_val(benchmark::State & state) {
+	allocation_report report(state);
+	for (auto _ : state) {
+		auto v = make_val<base1, Payload>();
+		benchmark::DoNotOptimize(v);
+	}
+}
+BENCHMARK_TEMPLATE(construct_val, small_payload);
+BENCHMARK_TEMPLATE(construct_val, large_payload);
+
+template <typename Payload>
+static void construct_val_small_storage(benchmark::State & state) {
+	allocation_report report(state);
+	for (auto _ : state) {
+		bench_val v(std::in_place_type<Payload>);
+		benchmark::DoNotOptimize(v);
+	}
+}
+BENCHMARK_TEMPLATE(construct_val_small_storage, small_payload);
+BENCHMARK_TEMPLATE(construct_val_small_storage, large_payload);
+
+template <typename Payload>
+static void construct_val_unique(benchmark::State & state) {
+	allocation_report report(state);
+	for (auto _ : state) {
+		bench_val_unique v(std::in_place_type<Payload>);
+		benchmark::DoNotOptimize(v);
+	}
+}
+BENCHMARK_TEMPLATE(construct_val_unique, small_payload);
+BENCHMARK_TEMPLATE(construct_val_unique, large_payload);
+
+template <typename Payload>
+static void construct_unique_ptr(benchmark::State & state) {
+	allocation_report report(state);
+	for (auto _ : state) {
+		std::unique_ptr<base1> p(new Payload());
+		benchmark::DoNotOptimize(p);
+	}
+}
+BENCHMARK_TEMPLATE(construct_unique_ptr, small_payload);
+BENCHMARK_TEMPLATE(construct_unique_ptr, large_payload);
+
+template <typename Payload>
+static void construct_shared_ptr(benchmark::State & state) {
+	allocation_report report(state);
+	for (auto _ : state) {
+		std::shared_ptr<base1> p = std::make_shared<Payload>();
+		benchmark::DoNotOptimize(p);
+	}
+}
+BENCHMARK_TEMPLATE(construct_shared_ptr, small_payload);
+BENCHMARK_TEMPLATE(construct_shared_ptr, large_payload);
+
+template <typename Payload>
+static void construct_any(benchmark::State & state) {
+	allocation_report report(state);
+	for (auto _ : state) {
+		std::any a(std::in_place_type<Payload>);
+		benchmark::DoNotOptimize(a);
+	}
+}
+BENCHMARK_TEMPLATE(construct_any, small_payload);
+BENCHMARK_TEMPLATE(construct_any, large_payload);
+
+template <typename Payload>
+static void construct_function(benchmark::State & state) {
+	allocation_report report(state);
+	Payload const captured;
+	for (auto _ : state) {
+		std::function<int32_t()> f([captured]() { return captured.value1; });
+		benchmark::DoNotOptimize(f);
+	}
+}
+BENCHMARK_TEMPLATE(construct_function, small_payload);
+BENCHMARK_TEMPLATE(construct_function, large_payload);
+
+template <typename Payload>
+static void construct_val_function(benchmark::State & state) {
+	allocation_report report(state);
+	Payload const captured;
+	for (auto _ : state) {
+		val_function<int32_t(), storage_size> f([captured]() { return captured.value1; });
+		benchmark::DoNotOptimize(f);
+	}
+}
+BENCHMARK_TEMPLATE(construct_val_function, small_payload);
+BENCHMARK_TEMPLATE(construct_val_function, large_payload);
+
+// destruction alone, timed over batches constructed outside the measurement
+template <typename Payload>
+static void destroy_val(benchmark::State & state) {
+	std::vector<bench_val> batch;
+	batch.reserve(batch_size);
+	for (auto _ : state) {
+		state.PauseTiming();
+		for (int64_t i = 0; i < batch_size; ++i) {
+			batch.emplace_back(std::in_place_type<Payload>);
+		}
+		state.ResumeTiming();
+		batch.clear();
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK_TEMPLATE(destroy_val, small_payload);
+BENCHMARK_TEMPLATE(destroy_val, large_payload);
+
+template <typename Payload>
+static void destroy_unique_ptr(benchmark::State & state) {
+	std::vector<std::unique_ptr<base1>> batch;
+	batch.reserve(batch_size);
+	for (auto _ : state) {
+		state.PauseTiming();
+		for (int64_t i = 0; i < batch_size; ++i) {
+			batch.emplace_back(new Payload());
+		}
+		state.ResumeTiming();
+		batch.clear();
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK_TEMPLATE(destroy_unique_ptr, small_payload);
+BENCHMARK_TEMPLATE(destroy_unique_ptr, large_payload);
+
+// copying
+
+template <typename Payload>
+static void copy_val(benchmark::State & state) {
+	bench_val const v(std::in_place_type<Payload>);
+	allocation_report report(state);
+	for (auto _ : state) {
+		bench_val copy(v);
+		benchmark::DoNotOptimize(copy);
+	}
+}
+BENCHMARK_TEMPLATE(copy_val, small_payload);
+BENCHMARK_TEMPLATE(copy_val, large_payload);
+
+template <typename Payload>
+static void copy_val_unique(benchmark::State & state) {
+	bench_val_unique const v(std::in_place_type<Payload>);
+	allocation_report report(state);
+	for (auto _ : state) {
+		bench_val_unique copy(v);
+		benchmark::DoNotOptimize(copy);
+	}
+}
+BENCHMARK_TEMPLATE(copy_val_unique, small_payload);
+BENCHMARK_TEMPLATE(copy_val_unique, large_payload);
+
+// heap objects are shared between copies, so copying is a reference count increment
+template <typename Payload>
+static void copy_val_cow(benchmark::State & state) {
+	val_cow<base1, storage_size> const v(std::in_place_type<Payload>);
+	allocation_report report(state);
+	for (auto _ : state) {
+		val_cow<base1, storage_size> copy(v);
+		benchmark::DoNotOptimize(copy);
+	}
+}
+BENCHMARK_TEMPLATE(copy_val_cow, small_payload);
+BENCHMARK_TEMPLATE(copy_val_cow, large_payload);
+
+// assignment between vals of the same dynamic type copy assigns in place
+template <typename Payload>
+static void assign_val(benchmark::State & state) {
+	bench_val const v(std::in_place_type<Payload>);
+	bench_val target(std::in_place_type<Payload>);
+	allocation_report report(state);
+	for (auto _ : state) {
+		target = v;
+		benchmark::DoNotOptimize(target);
+	}
+}
+BENCHMARK_TEMPLATE(assign_val, small_payload);
+BENCHMARK_TEMPLATE(assign_val, large_payload);
+
+// the deep copy equivalent for unique_ptr
+template <typename Payload>
+static void copy_unique_ptr(benchmark::State & state) {
+	std::unique_ptr<Payload> const p(new Payload());
+	allocation_report report(state);
+	for (auto _ : state) {
+		std::unique_ptr<base1> copy(new Payload(*p));
+		benchmark::DoNotOptimize(copy);
+	}
+}
+BENCHMARK_TEMPLATE(copy_unique_ptr, small_payload);
+BENCHMARK_TEMPLATE(copy_unique_ptr, large_payload);
+
+template <typename Payload>
+static void copy_shared_ptr(benchmark::State & state) {
+	std::shared_ptr<base1> const p = std::make_shared<Payload>();
+	allocation_report report(state);
+	for (auto _ : state) {
+		std::shared_ptr<base1> copy(p);
+		benchmark::DoNotOptimize(copy);
+	}
+}
+BENCHMARK_TEMPLATE(copy_shared_ptr, small_payload);
+BENCHMARK_TEMPLATE(copy_shared_ptr, large_payload);
+
+template <typename Payload>
+static void copy_any(benchmark::State & state) {
+	std::any const a(std::in_place_type<Payload>);
+	allocation_report report(state);
+	for (auto _ : state) {
+		std::any copy(a);
+		benchmark::DoNotOptimize(copy);
+	}
+}
+BENCHMARK_TEMPLATE(copy_any, small_payload);
+BENCHMARK_TEMPLATE(copy_any, large_payload);
+
+template <typename Payload>
+static void copy_function(benchmark::State & state) {
+	Payload const captured;
+	std::function<int32_t()> const f([captured]() { return captured.value1; });
+	allocation_report report(state);
+	for (auto _ : state) {
+		std::function<int32_t()> copy(f);
+		benchmark::DoNotOptimize(copy);
+	}
+}
+BENCHMARK_TEMPLATE(copy_function, small_payload);
+BENCHMARK_TEMPLATE(copy_function, large_payload);
+
+static void copy_ptr(benchmark::State & state) {
+	val<base1, sizeof(derived1)> v((derived1()));
+	ptr<base1> p(v);
+	allocation_report report(state);
+	for (auto _ : state) {
+		ptr<base1> q(p);
+		benchmark::DoNotOptimize(q);
+	}
+}
+BENCHMARK(copy_ptr);
+
+static void copy_ptr_single_threaded(benchmark::State & state) {
+	val<base1, sizeof(derived1), val_single_threaded> v((derived1()));
+	ptr<base1, val_single_threaded> p(v);
+	allocation_report report(state);
+	for (auto _ : state) {
+		ptr<base1, val_single_threaded> q(p);
+		benchmark::DoNotOptimize(q);
+	}
+}
+BENCHMARK(copy_ptr_single_threaded);
+
+// moving
+
+template <typename Payload>
+static void move_val(benchmark::State & state) {
+	bench_val v(std::in_place_type<Payload>);
+	allocation_report report(state);
+	for (auto _ : state) {
+		bench_val moved(std::move(v));
+		v = std::move(moved);
+		benchmark::DoNotOptimize(v);
+	}
+}
+BENCHMARK_TEMPLATE(move_val, small_payload);
+BENCHMARK_TEMPLATE(move_val, large_payload);
+
+// vector growth relocates every element
+template <typename Payload>
+static void grow_vector_of_val(benchmark::State & state) {
+	std::vector<bench_val> v;
+	for (int64_t i = 0; i < batch_size; ++i) {
+		v.emplace_back(std::in_place_type<Payload>);
+	}
+	allocation_report report(state);
+	for (auto _ : state) {
+		v.shrink_to_fit();
+		v.reserve(v.capacity() * 2);
+		benchmark::DoNotOptimize(v.data());
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK_TEMPLATE(grow_vector_of_val, small_payload);
+BENCHMARK_TEMPLATE(grow_vector_of_val, large_payload);
+
+namespace {
+
+	// the same payload, declared trivially relocatable
+	template <size_t Size>
+	struct relocatable_payload : payload<Size> {};
+
+}
+
+template <size_t Size>
+struct val_is_trivially_relocatable<relocatable_payload<Size>> : std::true_type {};
+
+// val_vector growth relocates through the op table, or copies the arena when every element is trivially relocatable
+template <typename Payload>
+static void grow_val_vector(benchmark::State & state) {
+	val_vector<base1> v;
+	for (int64_t i = 0; i < batch_size; ++i) {
+		v.template emplace_back<Payload>();
+	}
+	for (auto _ : state) {
+		val_vector<base1> grown(std::move(v));
+		grown.reserve(grown.size(), grown.arena_capacity() + 1);
+		v = std::move(grown);
+		benchmark::DoNotOptimize(&v.front());
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK_TEMPLATE(grow_val_vector, small_payload);
+BENCHMARK_TEMPLATE(grow_val_vector, relocatable_payload<48>);
+
+// erasing the front element shifts every following element down
+template <typename Payload>
+static void erase_val_vector(benchmark::State & state) {
+	val_vector<base1> v;
+	for (int64_t i = 0; i < batch_size; ++i) {
+		v.template emplace_back<Payload>();
+	}
+	for (auto _ : state) {
+		v.erase(v.begin());
+		v.template emplace_back<Payload>();
+		benchmark::DoNotOptimize(&v.front());
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK_TEMPLATE(erase_val_vector, small_payload);
+BENCHMARK_TEMPLATE(erase_val_vector, relocatable_payload<48>);
+
+// dereferencing
+
+// baseline: a raw pointer load plus the member access
+static void deref_raw_pointer(benchmark::State & state) {
+	derived1 d;
+	base1 * p = &d;
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(p);
+		benchmark::DoNotOptimize(p->value1);
+	}
+}
+BENCHMARK(deref_raw_pointer);
+
+static void deref_unique_ptr(benchmark::State & state) {
+	std::unique_ptr<base1> p(new derived1());
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(p);
+		benchmark::DoNotOptimize(p->value1);
+	}
+}
+BENCHMARK(deref_unique_ptr);
+
+static void deref_shared_ptr(benchmark::State & state) {
+	std::shared_ptr<base1> p = std::make_shared<derived1>();
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(p);
+		benchmark::DoNotOptimize(p->value1);
+	}
+}
+BENCHMARK(deref_shared_ptr);
+
+static void deref_any(benchmark::State & state) {
+	std::any a(std::in_place_type<derived1>);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(a);
+		benchmark::DoNotOptimize(std::any_cast<derived1 &>(a).value1);
+	}
+}
+BENCHMARK(deref_any);
+
+static void deref_val(benchmark::State & state) {
+	val<base1, sizeof(derived1)> v((derived1()));
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(v);
+		benchmark::DoNotOptimize(v->value1);
+	}
+}
+BENCHMARK(deref_val);
+
+static void deref_ptr(benchmark::State & state) {
+	val<base1, sizeof(derived1)> v((derived1()));
+	ptr<base1> p(v);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(p);
+		benchmark::DoNotOptimize(p->value1);
+	}
+}
+BENCHMARK(deref_ptr);
+
+// visiting
+
+namespace {
+
+	struct shape {
+		virtual ~shape() = default;
+		virtual int32_t area() const = 0;
+	};
+
+	struct square final : shape {
+		explicit square(int32_t const side) : side(side) {}
+		int32_t area() const override { return side * side; }
+		int32_t side;
+	};
+
+	struct rectangle final : shape {
+		rectangle(int32_t const width, int32_t const height) : width(width), height(height) {}
+		int32_t area() const override { return width * height; }
+		int32_t width;
+		int32_t height;
+	};
+
+	struct triangle final : shape {
+		triangle(int32_t const base, int32_t const height) : base(base), height(height) {}
+		int32_t area() const override { return base * height / 2; }
+		int32_t base;
+		int32_t height;
+	};
+
+	std::vector<val<shape, 16>> make_shapes() {
+		std::vector<val<shape, 16>> shapes;
+		for (int32_t i = 0; i < batch_size; ++i) {
+			switch (i % 3) {
+			case 0: shapes.emplace_back(square(i)); break;
+			case 1: shapes.emplace_back(rectangle(i, 2)); break;
+			default: shapes.emplace_back(triangle(i, 4)); break;
+			}
+		}
+		return shapes;
+	}
+
+}
+
+// a virtual call per element
+static void sum_areas_virtual(benchmark::State & state) {
+	auto const shapes = make_shapes();
+	for (auto _ : state) {
+		int32_t total = 0;
+		for (auto const & s : shapes) {
+			total += s->area();
+		}
+		benchmark::DoNotOptimize(total);
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(sum_areas_virtual);
+
+// visit over the closed set of final shapes, so that area is called directly and inlined
+static void sum_areas_visit(benchmark::State & state) {
+	auto const shapes = make_shapes();
+	for (auto _ : state) {
+		int32_t total = 0;
+		for (auto const & s : shapes) {
+			total += visit<square, rectangle, triangle>(s, [](auto const & concrete) { return concrete.area(); });
+		}
+		benchmark::DoNotOptimize(total);
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(sum_areas_visit);
+
+namespace {
+
+	// the same shapes without a base or virtual functions, erased through an interface
+	struct plain_square {
+		int32_t area() const { return side * side; }
+		int32_t side;
+	};
+
+	struct plain_rectangle {
+		int32_t area() const { return width * height; }
+		int32_t width;
+		int32_t height;
+	};
+
+	struct plain_triangle {
+		int32_t area() const { return base * height / 2; }
+		int32_t base;
+		int32_t height;
+	};
+
+	struct area_interface {
+		typedef val_iface_signatures<int32_t() const> signatures;
+
+		template <typename T>
+		static constexpr auto functions = std::make_tuple([](T const & t) { return t.area(); });
+
+		template <typename Self>
+		struct members {
+			int32_t area() const { return val_iface_call<0>(*this); }
+		};
+	};
+
+	std::vector<val_iface<area_interface>> make_plain_shapes() {
+		std::vector<val_iface<area_interface>> shapes;
+		for (int32_t i = 0; i < batch_size; ++i) {
+			switch (i % 3) {
+			case 0: shapes.emplace_back(plain_square{ i }); break;
+			case 1: shapes.emplace_back(plain_rectangle{ i, 2 }); break;
+			default: shapes.emplace_back(plain_triangle{ i, 4 }); break;
+			}
+		}
+		return shapes;
+	}
+
+}
+
+// one call through the function table of each element
+static void sum_areas_iface(benchmark::State & state) {
+	auto const shapes = make_plain_shapes();
+	for (auto _ : state) {
+		int32_t total = 0;
+		for (auto const & s : shapes) {
+			total += s.area();
+		}
+		benchmark::DoNotOptimize(total);
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(sum_areas_iface);
+
+// upcasting
+
+static void upcast_ptr(benchmark::State & state) {
+	val<small_payload, storage_size> v(std::in_place_type<small_payload>);
+	ptr<small_payload> p(v);
+	allocation_report report(state);
+	for (auto _ : state) {
+		ptr<base2> q(p);
+		benchmark::DoNotOptimize(q);
+	}
+}
+BENCHMARK(upcast_ptr);
+
+template <typename Payload>
+static void upcast_val(benchmark::State & state) {
+	val<Payload, storage_size> const v(std::in_place_type<Payload>);
+	allocation_report report(state);
+	for (auto _ : state) {
+		val<base2, storage_size> upcast(v);
+		benchmark::DoNotOptimize(upcast);
+	}
+}
+BENCHMARK_TEMPLATE(upcast_val, small_payload);
+BENCHMARK_TEMPLATE(upcast_val, large_payload);
+
+static void upcast_shared_ptr(benchmark::State & state) {
+	std::shared_ptr<small_payload> const p = std::make_shared<small_payload>();
+	allocation_report report(state);
+	for (auto _ : state) {
+		std::shared_ptr<base2> q(p);
+		benchmark::DoNotOptimize(q);
+	}
+}
+BENCHMARK(upcast_shared_ptr);
+
+// publishing
+
+// a read of an object that writers may replace
+static void load_atomic_val(benchmark::State & state) {
+	atomic_val<base1, sizeof(derived1)> slot((derived1()));
+	for (auto _ : state) {
+		auto const guard = slot.load();
+		benchmark::DoNotOptimize(guard->value1);
+	}
+}
+BENCHMARK(load_atomic_val)->ThreadRange(1, 4);
+
+static std::shared_ptr<base1> const published_shared_ptr = std::make_shared<derived1>();
+
+static void load_atomic_shared_ptr(benchmark::State & state) {
+	for (auto _ : state) {
+		auto const p = std::atomic_load(&published_shared_ptr);
+		benchmark::DoNotOptimize(p->value1);
+	}
+}
+BENCHMARK(load_atomic_shared_ptr)->ThreadRange(1, 4);
+
+// block churn
+
+// every thread creates vals in small storage, takes a ptr from each, which creates its block, and destroys them
+// build val_pool_bench to run this with VAL_BLOCK_POOL enabled
+static void churn_blocks(benchmark::State & state) {
+	std::vector<val<base1, sizeof(derived1)>> vals;
+	std::vector<ptr<base1>> ptrs;
+	vals.reserve(batch_size);
+	ptrs.reserve(batch_size);
+	for (auto _ : state) {
+		for (int64_t i = 0; i < batch_size; ++i) {
+			vals.emplace_back(derived1());
+			ptrs.emplace_back(vals.back());
+		}
+		ptrs.clear();
+		vals.clear();
+	}
+	state.SetItemsProcessed(state.iterations() * batch_size);
+}
+BENCHMARK(churn_blocks)->ThreadRange(1, 32)->UseRealTime();
+
+// memory resources
+
+// a batch of heap vals allocated from the global operator new
+static void construct_heap_batch_default(benchmark::State & state) {
+	std::vector<val<base1, 8>> batch;
+	batch.reserve(static_cast<size_t>(state.range(0)));
+	allocation_report report(state);
+	for (auto _ : state) {
+		for (int64_t i = 0; i < state.range(0); ++i) {
+			batch.push_back(make_val<base1, large_payload>());
+		}
+		batch.clear();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(construct_heap_batch_default)->Arg(1024);
+
+// the same batch allocated from a per-batch monotonic arena
+static void construct_heap_batch_monotonic(benchmark::State & state) {
+	std::vector<val<base1, 8>> batch;
+	batch.reserve(static_cast<size_t>(state.range(0)));
+	std::vector<int8_t> buffer(static_cast<size_t>(state.range(0)) * (sizeof(large_payload) + 64));
+	std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+	allocation_report report(state);
+	for (auto _ : state) {
+		for (int64_t i = 0; i < state.range(0); ++i) {
+			batch.push_back(allocate_val<base1, large_payload>(&arena));
+		}
+		batch.clear();
+		arena.release();
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(construct_heap_batch_monotonic)->Arg(1024);
+
+// the same batch constructed in one slab by make_vals
+static void construct_heap_batch_make_vals(benchmark::State & state) {
+	allocation_report report(state);
+	for (auto _ : state) {
+		auto batch = make_vals<base1, large_payload>(static_cast<size_t>(state.range(0)));
+		benchmark::DoNotOptimize(batch.begin());
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(construct_heap_batch_make_vals)->Arg(1024);
+
+// cloning a large range of heap vals on Arg(0) threads
+
+template <typename Clone>
+static void clone_range(benchmark::State & state, Clone const & clone) {
+	size_t const count = 1 << 16;
+	std::vector<val<base1, 8>> source;
+	source.reserve(count);
+	for (size_t i = 0; i < count; ++i) {
+		source.push_back(make_val<base1, large_payload>());
+	}
+	std::allocator<val<base1, 8>> allocator;
+	auto const copies = allocator.allocate(count);
+	for (auto _ : state) {
+		clone(source, copies);
+		state.PauseTiming();
+		val_destroy_range(copies, copies + count, val_serial_executor());
+		state.ResumeTiming();
+	}
+	allocator.deallocate(copies, count);
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(count));
+}
+
+static void clone_range_global(benchmark::State & state) {
+	val_thread_executor const executor(static_cast<size_t>(state.range(0)));
+	clone_range(state, [&](auto const & source, auto * copies) { val_clone_range(source.begin(), source.end(), copies, executor); });
+}
+BENCHMARK(clone_range_global)->Arg(1)->Arg(4)->UseRealTime();
+
+static void clone_range_arenas(benchmark::State & state) {
+	val_thread_executor const executor(static_cast<size_t>(state.range(0)));
+	val_clone_arenas arenas;
+	clone_range(state, [&](auto const & source, auto * copies) {
+		// the copies of the previous iteration have been destroyed, so their arenas can be released
+		arenas = val_clone_arenas();
+		val_clone_range(source.begin(), source.end(), copies, arenas, executor);
+	});
+}
+BENCHMARK(clone_range_arenas)->Arg(1)->Arg(4)->UseRealTime();
+
+// startup: rebuilding a val_vector of trivially copyable elements, or loading it from a snapshot
+
+namespace {
+
+	struct record {
+		int32_t kind;
+	};
+
+	struct small_record : record {
+		int32_t values[3];
+	};
+
+	struct large_record : record {
+		int64_t values[7];
+	};
+
+	constexpr size_t record_count = 1 << 16;
+
+	val_vector<record> make_records() {
+		val_vector<record> records;
+		for (size_t i = 0; i < record_count; ++i) {
+			if (i % 2 == 0) {
+				records.emplace_back<small_record>();
+			} else {
+				records.emplace_back<large_record>();
+			}
+		}
+		return records;
+	}
+
+}
+
+template <>
+struct val_type_id<small_record> : std::integral_constant<uint64_t, 1> {};
+
+template <>
+struct val_type_id<large_record> : std::integral_constant<uint64_t, 2> {};
+
+static void rebuild_records(benchmark::State & state) {
+	for (auto _ : state) {
+		auto records = make_records();
+		benchmark::DoNotOptimize(records.begin());
+	}
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(record_count));
+}
+BENCHMARK(rebuild_records);
+
+static void load_records_snapshot(benchmark::State & state) {
+	char const * const path = "val_bench_records.snapshot";
+	save_val_snapshot<small_record, large_record>(make_records(), path);
+	for (auto _ : state) {
+		auto records = load_val_snapshot<record, small_record, large_record>(path);
+		benchmark::DoNotOptimize(records.begin());
+	}
+	std::remove(path);
+	state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(record_count));
+}
+BENCHMARK(load_records_snapshot);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,183 @@
+// multithreaded contention benchmarks of ptr and block, which double as a stress harness
+// each reports the items processed per second at every thread count from 1 to 64, so the scaling curve can be tracked
+// build with -fsanitize=thread to check the memory ordering of the reference count, the lazy block allocation and the
+// expiration of ptrs whose val is destroyed
+// the races against ~val are only defined when ptrs expire, so this executable selects VAL_DANGLING_EXPIRE
+#define VAL_DANGLING VAL_DANGLING_EXPIRE
+
+#include "../include/val.hpp"
+
+#include "benchmark/benchmark.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace {
+
+	struct base1 {
+		base1() : value1(1) {}
+		virtual ~base1() = default;
+		int32_t value1;
+	};
+
+	struct derived1 : base1 {
+		derived1() : value2(2) {}
+		int32_t value2;
+	};
+
+	constexpr int max_threads = 64;
+
+	// blocks a round of every benchmark thread until all of them have arrived
+	class round_barrier {
+	public:
+		explicit round_barrier(int const count) : count(count) {}
+
+		void arrive_and_wait() {
+			std::unique_lock<std::mutex> lock(mutex);
+			auto const round = generation;
+			if (++waiting == count) {
+				waiting = 0;
+				++generation;
+				arrived.notify_all();
+			} else {
+				arrived.wait(lock, [&] { return generation != round; });
+			}
+		}
+
+	private:
+		std::mutex mutex;
+		std::condition_variable arrived;
+		int const count;
+		int waiting = 0;
+		size_t generation = 0;
+	};
+
+	val<base1, sizeof(derived1)> const shared_first((derived1()));
+	val<base1, sizeof(derived1)> const shared_second((derived1()));
+
+}
+
+static_assert(val_detail::dangling == val_detail::dangling_policy::expire);
+
+// shared ptrs
+
+// every thread copies and dereferences its own ptr to one val, so all of them update the count of one block
+static void copy_shared_ptr(benchmark::State & state) {
+	ptr<base1> const mine(shared_first);
+	for (auto _ : state) {
+		ptr<base1> const copy(mine);
+		benchmark::DoNotOptimize(copy->value1);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(copy_shared_ptr)->ThreadRange(1, max_threads)->UseRealTime();
+
+// every thread assigns its own ptr alternately from ptrs to two vals, updating the counts of both blocks
+static void assign_shared_ptr(benchmark::State & state) {
+	ptr<base1> const first(shared_first);
+	ptr<base1> const second(shared_second);
+	ptr<base1> current(first);
+	bool flip = false;
+	for (auto _ : state) {
+		current = flip ? first : second;
+		flip = !flip;
+		benchmark::DoNotOptimize(current->value1);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(assign_shared_ptr)->ThreadRange(1, max_threads)->UseRealTime();
+
+// a dereference only reads the block, so it should scale with the thread count
+static void deref_shared_ptr(benchmark::State & state) {
+	ptr<base1> const mine(shared_first);
+	for (auto _ : state) {
+		benchmark::DoNotOptimize(mine->value1);
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(deref_shared_ptr)->ThreadRange(1, max_threads)->UseRealTime();
+
+// false sharing
+
+namespace {
+
+	typedef val_detail::block<val_multi_threaded> shared_block;
+
+	constexpr size_t packed_alignment = alignof(shared_block);
+	constexpr size_t cache_line_size = 64;
+
+	void retain_block(shared_block *) noexcept {}
+
+	derived1 block_object;
+
+	// a block that starts at a multiple of Alignment
+	// at the natural alignment of a block, neighbouring blocks share cache lines, as blocks from one allocator often do
+	template <size_t Alignment>
+	struct alignas(Alignment) placed_block {
+		placed_block() : b(&block_object, &val_detail::op_table_of<derived1>, &retain_block) {
+			b.increment(); // never released, so the count does not reach zero
+		}
+
+		shared_block b;
+	};
+
+	template <size_t Alignment>
+	placed_block<Alignment> placed_blocks[max_threads];
+
+}
+
+// every thread takes and releases references to its own block, which is only contended through its cache line
+template <size_t Alignment>
+static void count_distinct_blocks(benchmark::State & state) {
+	shared_block & mine = placed_blocks<Alignment>[state.thread_index()].b;
+	for (auto _ : state) {
+		mine.increment();
+		mine.decrement();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(count_distinct_blocks, packed_alignment)->ThreadRange(1, max_threads)->UseRealTime();
+BENCHMARK_TEMPLATE(count_distinct_blocks, cache_line_size)->ThreadRange(1, max_threads)->UseRealTime();
+
+// destruction
+
+namespace {
+
+	std::optional<round_barrier> destroy_barrier;
+	std::optional<val<base1, sizeof(derived1)>> destroyed_val;
+
+}
+
+// each round, every thread takes a ptr from a new val in small storage, racing to allocate its block, and then the
+// first thread destroys the val while the others copy their ptrs until they observe that it expired
+// a ptr may not be dereferenced while its val is destroyed, so the others only copy it and test expired
+static void destroy_shared_val(benchmark::State & state) {
+	if (state.thread_index() == 0) {
+		destroy_barrier.emplace(state.threads());
+	}
+	for (auto _ : state) {
+		if (state.thread_index() == 0) {
+			destroyed_val.emplace(derived1());
+		}
+		destroy_barrier->arrive_and_wait();
+		std::optional<ptr<base1>> holder(*destroyed_val);
+		benchmark::DoNotOptimize((*holder)->value1);
+		destroy_barrier->arrive_and_wait();
+		if (state.thread_index() == 0) {
+			destroyed_val.reset();
+		} else {
+			while (!holder->expired()) {
+				ptr<base1> const copy(*holder);
+				benchmark::DoNotOptimize(copy.expired());
+				std::this_thread::yield();
+			}
+		}
+		holder.reset();
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(destroy_shared_val)->ThreadRange(1, max_threads)->UseRealTime();
+
+BENCHMARK_MAIN();
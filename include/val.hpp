@@ -5,21 +5,136 @@
 #define INCLUDED_UTILITIES_VAL_HPP
 
 #include <atomic>
+#include <algorithm>
 #include <cassert>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <iostream>
+#include <functional>
+#include <iterator>
 #include <memory>
-#include <mutex>
+#include <memory_resource>
 #include <optional>
+#include <tuple>
+#include <typeinfo>
 
 #include <utility>
+#include <variant>
+
+#include "val_block_pool.hpp"
+#include "val_instrumentation.hpp"
+
+// VAL_DANGLING selects what happens when the object of a val is destroyed while ptrs still refer to it.
+// VAL_DANGLING_ABORT reports the number of dangling ptrs and aborts. VAL_DANGLING_EXPIRE leaves the ptrs expired, see
+// ptr::expired. VAL_DANGLING_UNCHECKED assumes that there are none, so destruction performs no atomic operations.
+// It defaults to VAL_DANGLING_ABORT, or to VAL_DANGLING_UNCHECKED when NDEBUG is defined, and must have the same value
+// in every translation unit of a program.
+#define VAL_DANGLING_ABORT 0
+#define VAL_DANGLING_EXPIRE 1
+#define VAL_DANGLING_UNCHECKED 2
+
+#ifndef VAL_DANGLING
+#	ifdef NDEBUG
+#		define VAL_DANGLING VAL_DANGLING_UNCHECKED
+#	else
+#		define VAL_DANGLING VAL_DANGLING_ABORT
+#	endif
+#endif
 
-template <typename T>
+namespace val_detail {
+	template <typename V>
+	class plain_cell;
+
+	enum class dangling_policy {
+		abort,
+		expire,
+		unchecked,
+	};
+
+	constexpr dangling_policy dangling = VAL_DANGLING == VAL_DANGLING_EXPIRE ? dangling_policy::expire : VAL_DANGLING == VAL_DANGLING_UNCHECKED ? dangling_policy::unchecked : dangling_policy::abort;
+
+	[[noreturn]] inline void abort_dangling(char const * owner, intptr_t count) noexcept {
+		std::fprintf(stderr, "Destruction of a %s with %td dangling ptr(s). Aborting!\n", owner, static_cast<ptrdiff_t>(count));
+		std::abort();
+	}
+}
+
+// threading policies for val and ptr, which select how the reference count and object address they share are stored
+
+// a val and its ptrs may be used from different threads, so the shared state is atomic
+struct val_multi_threaded {
+	template <typename V>
+	using cell = std::atomic<V>;
+};
+
+// a val and all of its ptrs are confined to one thread, so the shared state is a plain integer and pointer
+struct val_single_threaded {
+	template <typename V>
+	using cell = val_detail::plain_cell<V>;
+};
+
+template <typename T, typename Threading = val_multi_threaded>
 class ptr;
 
-template <typename T, size_t SmallStorageSize>
+template <typename T, size_t SmallStorageSize, typename Threading>
 class val;
 
+template <typename T, size_t SmallStorageSize, bool Copyable>
+class val_unique;
+
+template <typename T, typename U, typename Threading>
+class val_batch;
+
+// specialize for a base type to choose the default small storage of val<Base> and val_unique<Base>
+// a specialization provides size, and optionally alignment and require_small_storage, usually by inheriting val_derived_types:
+//   template <> struct val_storage_hint<shape> : val_derived_types<shape, square, circle> {};
+// when require_small_storage is true, a val<Base> whose small storage cannot hold every registered type fails to compile
+template <typename Base>
+struct val_storage_hint {};
+
+// the storage needed to hold any of Base and its expected derived types in small storage
+template <typename Base, typename... Derived>
+struct val_derived_types {
+	static_assert((std::is_base_of<Base, Derived>::value && ...), "val_derived_types must be derived from Base");
+
+	static constexpr size_t size = std::max({ sizeof(Base), sizeof(Derived)... });
+	static constexpr size_t alignment = std::max({ alignof(Base), alignof(Derived)... });
+	// an abstract Base is never stored itself
+	static constexpr bool nothrow_movable = (std::is_abstract<Base>::value || std::is_nothrow_move_constructible<Base>::value) && (std::is_nothrow_move_constructible<Derived>::value && ...);
+	static constexpr bool require_small_storage = false;
+};
+
+// specialize as std::true_type for types that may be relocated by copying their bytes and not running the destructor
+// of the source, in the sense of P1144; trivially copyable types are trivially relocatable
+template <typename T>
+struct val_is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <typename T>
+constexpr bool val_is_trivially_relocatable_v = val_is_trivially_relocatable<T>::value;
+
+// specialize as std::true_type for a base type that is at the start of every type held through it, as with single
+// inheritance, so that val<Base>, val_unique<Base>, val_cow<Base> and ptr<Base> do not store the offset of the Base
+// subobject; converting to a flagged base asserts that the offset is zero, which is checked only in debug builds, as
+// the offset of a base cannot be computed in a constant expression for a static_assert; when NDEBUG is defined, flagging
+// a base that is not at the start of an object is undefined behavior
+template <typename Base>
+struct val_zero_upcast_offset : std::false_type {};
+
+template <typename Base>
+constexpr bool val_zero_upcast_offset_v = val_zero_upcast_offset<Base>::value;
+
+// specialize as std::true_type for a type whose copy assignment may be used when a val is assigned from a val holding
+// the same type, reusing the object and its storage instead of copying into a temporary and moving it; by default only
+// types with a trivial copy constructor and copy assignment are assigned in place, because the copy assignment of
+// another type may be ill-formed even though std::is_copy_assignable reports it, as for a struct with a std::vector
+// member whose elements are not assignable; a polymorphic type is never trivial, so it must opt in
+template <typename T>
+struct val_assign_in_place : std::bool_constant<std::is_trivially_copy_assignable<T>::value && std::is_trivially_copy_constructible<T>::value> {};
+
+template <typename T>
+constexpr bool val_assign_in_place_v = val_assign_in_place<T>::value;
+
 namespace val_detail {
 
 	// CppUTest causes issues with placement new
@@ -38,6 +153,11 @@ namespace val_detail {
 		return new (placement) T(std::forward<T>(data));
 	}
 
+	template <typename T, typename... ArgTs>
+	static T * placement_construct(void * placement, ArgTs &&... args) {
+		return new (placement) T(std::forward<ArgTs>(args)...);
+	}
+
 	#if CPPUTEST_USE_NEW_MACROS
 	#	include <CppUTest/MemoryLeakDetectorNewMacros.h>
 	#endif
@@ -45,46 +165,254 @@ namespace val_detail {
 	template <typename T>
 	constexpr bool false_upon_instatiation = !std::is_same<T, T>::value;
 
-	enum operation {
-		CLONE,
-		DELETE,
-		DESTRUCT,
-		SIZE,
-		TYPE
+	// stands in for the copied type when copying is disabled
+	struct no_copy_source {
+		no_copy_source() = delete;
+	};
+
+	// the subset of the std::atomic interface used by val and ptr, without synchronization
+	template <typename V>
+	class plain_cell {
+	public:
+		plain_cell(V v) noexcept : value(v) {} //NOLINT(hicpp-explicit-conversions)
+		plain_cell(plain_cell const &) = delete;
+		plain_cell& operator =(plain_cell const &) = delete;
+
+		V load(std::memory_order = std::memory_order_seq_cst) const noexcept {
+			return value;
+		}
+
+		void store(V v, std::memory_order = std::memory_order_seq_cst) noexcept {
+			value = v;
+		}
+
+		V exchange(V v, std::memory_order = std::memory_order_seq_cst) noexcept {
+			V const result = value;
+			value = v;
+			return result;
+		}
+
+		bool compare_exchange_strong(V & expected, V desired, std::memory_order = std::memory_order_seq_cst, std::memory_order = std::memory_order_seq_cst) noexcept {
+			if (value != expected) {
+				expected = value;
+				return false;
+			}
+			value = desired;
+			return true;
+		}
+
+		V fetch_add(V v, std::memory_order = std::memory_order_seq_cst) noexcept {
+			V const result = value;
+			value += v;
+			return result;
+		}
+
+		V fetch_sub(V v, std::memory_order = std::memory_order_seq_cst) noexcept {
+			V const result = value;
+			value -= v;
+			return result;
+		}
+
+	private:
+		V value;
 	};
 
+	// the operations and properties of an erased type, one constant instance per type
+	struct op_table {
+		void * (*clone)(void const * value, void * placement); // copy to placement, or to the heap when placement is nullptr
+		void * (*move)(void * value, void * placement); // relocate to placement, or to the heap when placement is nullptr
+		void (*destruct)(void const * value);
+		void (*delete_)(void const * value);
+		void (*assign)(void const * value, void * placement); // copy assign, or nullptr unless val_assign_in_place
+		size_t (*hash)(void const * value); // std::hash, or nullptr if it is not enabled for the type
+		bool (*equal)(void const * a, void const * b); // operator ==, or nullptr if the type has none
+		bool (*less)(void const * a, void const * b); // operator <, or nullptr if the type has none
+		size_t size;
+		size_t alignment;
+		bool nothrow_movable;
+		bool trivially_relocatable; // move may be replaced by copying size bytes
+		std::type_info const * type;
+	};
+
+	// the reference count and current address of an object, shared by the val that owns it and its ptrs
+	// the type of the object cannot change while the block exists, so it is kept here rather than in every ptr
+	template <typename Threading>
 	struct block {
-		std::atomic<intptr_t> count;
-		std::atomic<void *> data; // Ensure that propagation of this value to other threads is immediate
+		typedef void(*deallocate_sig)(block *) noexcept;
+
+		typename Threading::template cell<intptr_t> count;
+		typename Threading::template cell<void *> data; // the address of the object, which moves with it
+		op_table const * const op; // the type of the object
+		deallocate_sig const deallocate; // frees this block, and the object storage if it is co-located
 
-		explicit block(void * d) : count(0), data(d) {
+		block(void * d, op_table const * o, deallocate_sig dealloc) : count(0), data(d), op(o), deallocate(dealloc) {
 			if (d == nullptr) {
 				throw std::invalid_argument("block::block(void *) received a nullptr");
 			}
 		}
 
+		// as with std::shared_ptr, taking a reference needs no ordering, because the caller already holds one
 		void increment() {
-			count.fetch_add(1);
+			count.fetch_add(1, std::memory_order_relaxed);
 		}
 
+		// releasing a reference orders the prior uses of the object before its deallocation by the last owner
 		void decrement() {
-			if (count.fetch_sub(1) == 1) {
-				delete this;
+			if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				deallocate(this);
 			}
 		}
 	};
 
-	typedef intptr_t(*op_sig)(operation, void const *, void *);
+	template <typename Threading>
+	void delete_block(block<Threading> * b) noexcept {
+		delete b;
+	}
+
+	template <typename Threading>
+	void deallocate_pooled_block(block<Threading> * b) noexcept {
+		b->~block();
+		block_pool::deallocate(static_cast<void *>(b));
+	}
+
+	// a block that is not co-located with its object, from the block pool if VAL_BLOCK_POOL is enabled
+	template <typename Threading>
+	block<Threading> * allocate_block(void * d, op_table const * op) {
+		if constexpr (block_pool::enabled) {
+			static_assert(sizeof(block<Threading>) <= block_pool::slot_size, "a block must fit in a block pool slot");
+			void * const memory = block_pool::allocate();
+			try {
+				return new (memory) block<Threading>(d, op, &deallocate_pooled_block<Threading>);
+			} catch (...) {
+				block_pool::deallocate(memory);
+				throw;
+			}
+		} else {
+			return new block<Threading>(d, op, &delete_block<Threading>);
+		}
+	}
+
+	// a co-located block shares one allocation with the object, which is at a fixed offset after the block
+	template <typename Threading>
+	void deallocate_colocated(block<Threading> * b) noexcept {
+		b->~block();
+		::operator delete(static_cast<void *>(b));
+	}
+
+	template <typename Threading>
+	void deallocate_resource_block(block<Threading> * b) noexcept;
+
+	// a co-located block whose allocation came from a memory resource
+	template <typename Threading>
+	struct resource_block : block<Threading> {
+		std::pmr::memory_resource * const resource;
+		size_t const bytes;
+		size_t const alignment;
+
+		resource_block(void * d, op_table const * o, std::pmr::memory_resource * r, size_t bytes, size_t alignment) : block<Threading>(d, o, &deallocate_resource_block<Threading>), resource(r), bytes(bytes), alignment(alignment) {}
+	};
+
+	template <typename Threading>
+	void deallocate_resource_block(block<Threading> * b) noexcept {
+		auto const r = static_cast<resource_block<Threading> *>(b);
+		auto const resource = r->resource;
+		auto const bytes = r->bytes;
+		auto const alignment = r->alignment;
+		r->~resource_block();
+		resource->deallocate(static_cast<void *>(r), bytes, alignment);
+	}
+
+	template <typename Threading>
+	bool is_colocated(block<Threading> const * b) {
+		return b != nullptr && (b->deallocate == &deallocate_colocated<Threading> || b->deallocate == &deallocate_resource_block<Threading>);
+	}
+
+	// the memory resource that provided the storage of b, or nullptr for the global operator new
+	template <typename Threading>
+	std::pmr::memory_resource * resource_of(block<Threading> const * b) {
+		return b != nullptr && b->deallocate == &deallocate_resource_block<Threading> ? static_cast<resource_block<Threading> const *>(b)->resource : nullptr;
+	}
+
+	constexpr size_t align_up(size_t offset, size_t alignment) {
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	template <typename Block>
+	constexpr size_t colocated_offset(size_t alignment) {
+		return align_up(sizeof(Block), alignment);
+	}
+
+	// where a val places its object
+	// small storage has no block_ptr, heap storage is the object area of a co-located block
+	// a nullptr placement requests a separate heap allocation, used for over-aligned types
+	template <typename Threading>
+	struct storage {
+		void * placement;
+		block<Threading> * block_ptr;
+	};
+
+	template <typename Threading>
+	storage<Threading> allocate_colocated(op_table const * op, std::pmr::memory_resource * resource = nullptr) {
+		size_t const size = op->size;
+		size_t const alignment = op->alignment;
+		if (resource != nullptr) {
+			size_t const offset = colocated_offset<resource_block<Threading>>(alignment);
+			size_t const blockAlignment = std::max(alignment, alignof(resource_block<Threading>));
+			auto const memory = static_cast<int8_t *>(resource->allocate(offset + size, blockAlignment));
+			auto const b = new (memory) resource_block<Threading>(memory + offset, op, resource, offset + size, blockAlignment);
+			b->increment(); // the reference held by the owning val
+			return storage<Threading>{ memory + offset, b };
+		}
+		if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+			return storage<Threading>{ nullptr, nullptr };
+		}
+		size_t const offset = colocated_offset<block<Threading>>(alignment);
+		auto const memory = static_cast<int8_t *>(::operator new(offset + size));
+		auto const b = new (memory) block<Threading>(memory + offset, op, &deallocate_colocated<Threading>);
+		b->increment(); // the reference held by the owning val
+		return storage<Threading>{ memory + offset, b };
+	}
+
+	// the offset of a subobject that is known to be zero, which converts to size_t and ignores assignments of zero
+	struct zero_offset {
+		constexpr operator size_t() const { return 0; } //NOLINT(hicpp-explicit-conversions)
+
+		void operator =(size_t offset) const {
+			// only checked in debug builds, see val_zero_upcast_offset
+			assert(offset == 0 && "val_zero_upcast_offset is specialized for a base that is not at the start of an object");
+			(void)offset;
+		}
+	};
+
+	// the offset of the T subobject of an erased object, which is only stored when it can be non-zero
+	template <bool IsZero>
+	struct offset_storage {
+		size_t upcast_offset = 0;
+	};
 
-	struct descriptor_t {
-		block * block_ptr;
-		size_t upcast_offset;
-		op_sig op_ptr;
+	template <>
+	struct offset_storage<true> {
+		static constexpr zero_offset upcast_offset{};
 	};
 
+	template <typename T>
+	using offset_storage_of = offset_storage<val_zero_upcast_offset<typename std::remove_cv<T>::type>::value>;
+
+	// what a ptr<T> refers to: the block of an object and the offset of the T subobject within it
+	template <typename T, typename Threading>
+	struct descriptor_t : offset_storage_of<T> {
+		block<Threading> * block_ptr = nullptr;
+	};
+
+	// the offset of the T subobject of a U
+	// U* cannot be converted to T* in a constant expression, but the conversion of a constant folds away
 	template <typename T, typename U>
 	inline size_t compute_upcast_offset() {
-		return (size_t)((T*)((U*)1)) - 1;
+		if constexpr (std::is_same<T, U>::value) {
+			return 0;
+		} else {
+			return (size_t)((T*)((U*)1)) - 1;
+		}
 	}
 
 	template <typename T, bool IsClonable>
@@ -111,44 +439,229 @@ namespace val_detail {
 		}
 	};
 
+	// relocation: construct a new T from *data in placement (or on the heap when placement is nullptr) and destruct *data
+	template <typename T, bool IsMovable>
+	struct move_impl {
+		static_assert(false_upon_instatiation<T>, "template specialization failed");
+	};
+
+	template <typename T>
+	struct move_impl<T, true> {
+		static T * move(T * data, void * placement) {
+			T * const result = placement == nullptr ? new T(std::move(*data)) : placement_move<T>(std::move(*data), placement);
+			data->~T();
+			return result;
+		}
+	};
+
 	template <typename T>
-	static intptr_t op(operation o, void const * value, void * placement) {
-		auto const data = static_cast<T const *>(value);
-		switch (o) {
-		case CLONE:
-			return reinterpret_cast<intptr_t>(clone_impl<T, std::is_copy_constructible<T>::value>::clone(data, placement));
-		case DELETE:
-			delete data;
-			return 0;
-		case DESTRUCT:
+	struct move_impl<T, false> {
+		static T * move(T * data, void * placement) {
+			T * const result = clone_impl<T, std::is_copy_constructible<T>::value>::clone(data, placement);
 			data->~T();
-			return 0;
-		case SIZE:
-			return sizeof(T);
-		case TYPE:
-			return reinterpret_cast<intptr_t>(typeid(T).name());
+			return result;
 		}
-		throw;
+	};
+
+	template <typename T, typename = void>
+	struct is_hashable : std::false_type {};
+
+	template <typename T>
+	struct is_hashable<T, std::void_t<decltype(std::hash<T>()(std::declval<T const &>()))>> : std::is_default_constructible<std::hash<T>> {};
+
+	// the comparisons that an op table may provide
+	struct equal_comparison {
+		template <typename T>
+		using result = decltype(static_cast<bool>(std::declval<T const &>() == std::declval<T const &>()));
+	};
+
+	struct less_comparison {
+		template <typename T>
+		using result = decltype(static_cast<bool>(std::declval<T const &>() < std::declval<T const &>()));
+	};
+
+	template <typename Comparison, typename T, typename = void>
+	struct is_comparable : std::false_type {};
+
+	// the operators of the standard containers, pair, tuple, optional and variant are declared for every element type,
+	// and only fail to compile when their bodies are instantiated, so the element types are checked as well
+	template <typename Comparison, typename T, typename = void>
+	struct elements_comparable : std::true_type {};
+
+	template <typename Comparison, typename T>
+	struct elements_comparable<Comparison, T, std::void_t<typename T::value_type, decltype(std::begin(std::declval<T const &>()))>> : is_comparable<Comparison, typename std::remove_cv<typename T::value_type>::type> {};
+
+	template <typename Comparison, typename A, typename B>
+	struct elements_comparable<Comparison, std::pair<A, B>> : std::conjunction<is_comparable<Comparison, A>, is_comparable<Comparison, B>> {};
+
+	template <typename Comparison, typename... Ts>
+	struct elements_comparable<Comparison, std::tuple<Ts...>> : std::conjunction<is_comparable<Comparison, Ts>...> {};
+
+	template <typename Comparison, typename U>
+	struct elements_comparable<Comparison, std::optional<U>> : is_comparable<Comparison, U> {};
+
+	template <typename Comparison, typename... Ts>
+	struct elements_comparable<Comparison, std::variant<Ts...>> : std::conjunction<is_comparable<Comparison, Ts>...> {};
+
+	template <typename Comparison, typename T>
+	struct is_comparable<Comparison, T, std::void_t<typename Comparison::template result<T>>> : elements_comparable<Comparison, T> {};
+
+	template <typename T>
+	using is_equality_comparable = is_comparable<equal_comparison, T>;
+
+	template <typename T>
+	using is_less_comparable = is_comparable<less_comparison, T>;
+
+	template <typename T>
+	struct op_impl {
+		static void * clone(void const * value, void * placement) {
+			return clone_impl<T, std::is_copy_constructible<T>::value>::clone(static_cast<T const *>(value), placement);
+		}
+
+		static void * move(void * value, void * placement) {
+			return move_impl<T, std::is_move_constructible<T>::value>::move(static_cast<T *>(value), placement);
+		}
+
+		static void destruct(void const * value) {
+			static_cast<T const *>(value)->~T();
+		}
+
+		static void delete_(void const * value) {
+			delete static_cast<T const *>(value);
+		}
+
+		static void assign(void const * value, void * placement) {
+			*static_cast<T *>(placement) = *static_cast<T const *>(value);
+		}
+
+		static constexpr auto assign_ptr() {
+			if constexpr (val_assign_in_place<T>::value) {
+				return &assign;
+			} else {
+				return static_cast<void (*)(void const *, void *)>(nullptr);
+			}
+		}
+
+		static size_t hash(void const * value) {
+			return std::hash<T>()(*static_cast<T const *>(value));
+		}
+
+		static bool equal(void const * a, void const * b) {
+			return static_cast<bool>(*static_cast<T const *>(a) == *static_cast<T const *>(b));
+		}
+
+		static bool less(void const * a, void const * b) {
+			return static_cast<bool>(*static_cast<T const *>(a) < *static_cast<T const *>(b));
+		}
+
+		static constexpr auto hash_ptr() {
+			if constexpr (is_hashable<T>::value) {
+				return &hash;
+			} else {
+				return static_cast<size_t (*)(void const *)>(nullptr);
+			}
+		}
+
+		static constexpr auto equal_ptr() {
+			if constexpr (is_equality_comparable<T>::value) {
+				return &equal;
+			} else {
+				return static_cast<bool (*)(void const *, void const *)>(nullptr);
+			}
+		}
+
+		static constexpr auto less_ptr() {
+			if constexpr (is_less_comparable<T>::value) {
+				return &less;
+			} else {
+				return static_cast<bool (*)(void const *, void const *)>(nullptr);
+			}
+		}
+	};
+
+	template <typename T>
+	inline constexpr op_table op_table_of = {
+		&op_impl<T>::clone,
+		&op_impl<T>::move,
+		&op_impl<T>::destruct,
+		&op_impl<T>::delete_,
+		op_impl<T>::assign_ptr(),
+		op_impl<T>::hash_ptr(),
+		op_impl<T>::equal_ptr(),
+		op_impl<T>::less_ptr(),
+		sizeof(T),
+		alignof(T),
+		std::is_nothrow_move_constructible<T>::value,
+		val_is_trivially_relocatable<T>::value,
+		&typeid(T)
+	};
+
+	inline void * clone(op_table const * op_ptr, void const * value, void * placement) {
+		return op_ptr->clone(value, placement);
+	}
+
+	inline void * move(op_table const * op_ptr, void * value, void * placement) {
+		return op_ptr->move(value, placement);
+	}
+
+	// copy assign value to placement, both of the type of op_ptr, returning false if the type is not assigned in place
+	inline bool assign(op_table const * op_ptr, void const * value, void * placement) {
+		if (op_ptr->assign == nullptr) {
+			return false;
+		}
+		op_ptr->assign(value, placement);
+		return true;
+	}
+
+	inline size_t hash(op_table const * op_ptr, void const * value) {
+		if (op_ptr->hash == nullptr) {
+			throw std::logic_error("type cannot be hashed");
+		}
+		return op_ptr->hash(value);
+	}
+
+	// a and b are both of the type of op_ptr
+	inline bool equal(op_table const * op_ptr, void const * a, void const * b) {
+		if (op_ptr->equal == nullptr) {
+			throw std::logic_error("type cannot be compared for equality");
+		}
+		return op_ptr->equal(a, b);
+	}
+
+	// a and b are both of the type of op_ptr
+	inline bool less(op_table const * op_ptr, void const * a, void const * b) {
+		if (op_ptr->less == nullptr) {
+			throw std::logic_error("type cannot be ordered");
+		}
+		return op_ptr->less(a, b);
+	}
+
+	inline bool nothrow_movable(op_table const * op_ptr) {
+		return op_ptr->nothrow_movable;
 	}
 
-	static void * clone(op_sig const & op_ptr, void const * value, void * placement) {
-		return reinterpret_cast<void *>(op_ptr(CLONE, value, placement));
+	inline bool trivially_relocatable(op_table const * op_ptr) {
+		return op_ptr->trivially_relocatable;
 	}
 
-	static void delete_(op_sig const & op_ptr, void const * value) {
-		op_ptr(DELETE, value, nullptr);
+	inline void delete_(op_table const * op_ptr, void const * value) {
+		op_ptr->delete_(value);
 	}
 
-	static void destruct(op_sig const & op_ptr, void const * value) {
-		op_ptr(DESTRUCT, value, nullptr);
+	inline void destruct(op_table const * op_ptr, void const * value) {
+		op_ptr->destruct(value);
 	}
 
-	inline static size_t size(op_sig const & op_ptr) {
-		return static_cast<size_t>(op_ptr(SIZE, nullptr, nullptr));
+	inline size_t size(op_table const * op_ptr) {
+		return op_ptr->size;
 	}
 
-	static char const * type(op_sig const & op_ptr) {
-		return reinterpret_cast<const char *>(op_ptr(TYPE, nullptr, nullptr));
+	inline size_t alignment(op_table const * op_ptr) {
+		return op_ptr->alignment;
+	}
+
+	inline std::type_info const & type(op_table const * op_ptr) {
+		return *op_ptr->type;
 	}
 
 	template <typename T, typename = void>
@@ -166,290 +679,977 @@ namespace val_detail {
 	template <typename DefaultSize, typename T>
 	struct small_storage_size_impl<DefaultSize, T, typename std::enable_if<is_complete_type<T>>::type> : std::integral_constant<size_t, sizeof(T)> {};
 
+	// the members of val_storage_hint<T>, with defaults for those that a specialization omits
+	template <typename T, typename = void>
+	struct storage_hint {
+		static constexpr bool present = false;
+		static constexpr size_t size = 0;
+	};
+
+	template <typename T>
+	struct storage_hint<T, std::void_t<decltype(val_storage_hint<T>::size)>> {
+		static constexpr bool present = true;
+		static constexpr size_t size = val_storage_hint<T>::size;
+	};
+
+	template <typename T, typename = void>
+	struct storage_hint_alignment : std::integral_constant<size_t, alignof(std::max_align_t)> {};
+
+	template <typename T>
+	struct storage_hint_alignment<T, std::void_t<decltype(val_storage_hint<T>::alignment)>> : std::integral_constant<size_t, val_storage_hint<T>::alignment> {};
+
+	template <typename T, typename = void>
+	struct storage_hint_nothrow_movable : std::true_type {};
+
+	template <typename T>
+	struct storage_hint_nothrow_movable<T, std::void_t<decltype(val_storage_hint<T>::nothrow_movable)>> : std::integral_constant<bool, val_storage_hint<T>::nothrow_movable> {};
+
+	template <typename T, typename = void>
+	struct storage_hint_required : std::false_type {};
+
+	template <typename T>
+	struct storage_hint_required<T, std::void_t<decltype(val_storage_hint<T>::require_small_storage)>> : std::integral_constant<bool, val_storage_hint<T>::require_small_storage> {};
+
+	// the default small storage size: the hinted size, else sizeof(T), else DefaultSize when T is incomplete
 	template <size_t DefaultSize, typename T>
-	constexpr size_t small_storage_size = small_storage_size_impl<std::integral_constant<size_t, DefaultSize>, T>::value;
+	constexpr size_t small_storage_size = storage_hint<T>::present ? storage_hint<T>::size : small_storage_size_impl<std::integral_constant<size_t, DefaultSize>, T>::value;
+
+	// small storage is aligned for any fundamental type, or more if the hint of T requires it
+	template <typename T>
+	constexpr size_t small_storage_alignment = std::max(alignof(std::max_align_t), storage_hint_alignment<T>::value);
 
+	// the std::type_info of T, or nullptr where T is incomplete
 	template <typename T, typename = void>
-	struct emit_heap_warning_imp {
-		static void emit_heap_warning(char const * const u_name) {
-			(void)u_name;
-#if !NDEBUG
-			//std::cerr << "Warning: a val allocated heap storage. Use the SmallStorageSize type parameter to improve locality. Type T is unknown. Type U is " << u_name << ".\n";
-#endif
-		}
+	struct type_of_impl {
+		static std::type_info const * get() { return nullptr; }
 	};
 
 	template <typename T>
-	struct emit_heap_warning_imp<T, typename std::enable_if<is_complete_type<T>, T>::type> {
-		static void emit_heap_warning(char const * const u_name) {
-			(void)u_name;
-#if !NDEBUG
-			//std::cerr << "Warning: a val allocated heap storage. Use the SmallStorageSize type parameter to improve locality. Type T is " << typeid(T).name() << ". Type U is " << u_name << ".\n";
-#endif
-		}
+	struct type_of_impl<T, typename std::enable_if<is_complete_type<T>>::type> {
+		static std::type_info const * get() { return &typeid(T); }
 	};
 
+	// report an event concerning an object of type op, held through a T, to val_instrumentation
 	template <typename T>
-	void emit_heap_warning(char const * const u_name) {
-		emit_heap_warning_imp<T>::emit_heap_warning(u_name);
-	}
-
-	template <typename T, typename U>
-	void emit_heap_warning2() {
-#if !NDEBUG
-		//std::cerr << "Warning: a val allocated heap storage. Use the SmallStorageSize type parameter to improve locality. Type T is " << typeid(T).name() << ". Type U is " << typeid(U).name() << ".\n";
-#endif
+	void instrument(val_instrumentation::event e, op_table const * op, size_t smallStorageSize) {
+		if constexpr (val_instrumentation::enabled) {
+			val_instrumentation::detail::record(e, val_instrumentation::event_info{ type_of_impl<T>::get(), op->type, op->size, op->alignment, op->nothrow_movable, smallStorageSize, small_storage_alignment<T> });
+		} else {
+			(void)e;
+			(void)op;
+			(void)smallStorageSize;
+		}
 	}
 }
 
 // non-nullable weak pointer to val objects
-template <typename T>
+//
+// With val_multi_threaded, thread safety follows std::shared_ptr: distinct ptr objects may be copied, assigned,
+// dereferenced and destroyed concurrently, even when they refer to the same val, because the block reference count is
+// atomic. Concurrent access to the same ptr object, where at least one access is an assignment, is a data race and
+// requires external synchronization. Dereferencing requires that the referenced val is neither being moved nor
+// destroyed concurrently. With val_single_threaded, a val and all of its ptrs must be used from one thread at a time.
+template <typename T, typename Threading>
 class ptr {  // NOLINT(cppcoreguidelines-special-member-functions, hicpp-special-member-functions)
-	template <typename>
+	template <typename, typename>
 	friend class ptr;
 
-	template <typename, size_t>
+	template <typename, size_t, typename>
 	friend class val;
 
-	using descriptor_t = val_detail::descriptor_t;
-	using block = val_detail::block;
-	using op_sig = val_detail::op_sig;
+	template <typename, typename, typename>
+	friend class val_batch;
+
+	using descriptor_t = val_detail::descriptor_t<T, Threading>;
+	using block = val_detail::block<Threading>;
+	using op_table = val_detail::op_table;
 
 public:
 	typedef T type;
 
 	// copy constructor
-	ptr(ptr const & other) {
-		const descriptor_t d = other.get_descriptor();
-		descriptor = d;
-		descriptor.block_ptr->increment();
+	ptr(ptr const & other) : descriptor(other.descriptor) {
+		increment();
 	}
 
 	ptr& operator =(ptr other) {
-		auto new_descriptor = other.get_descriptor();
-		new_descriptor.block_ptr->increment();
-		auto old_descriptor = exchange_descriptor(new_descriptor);
-		old_descriptor.block_ptr->decrement();
+		std::swap(descriptor, other.descriptor);
 		return *this;
 	}
 
 	~ptr() {
-		auto d = get_descriptor();
-		d.block_ptr->decrement();
+		val_detail::instrument<T>(val_instrumentation::event::ptr_decrement, descriptor.block_ptr->op, 0);
+		descriptor.block_ptr->decrement();
 	}
 
 	// construct from ptr<U> where U inherits T
 	template <typename U, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
-	ptr(ptr<U> const & other) { //NOLINT(hicpp-explicit-conversions)
-		descriptor = other.get_descriptor();
-		descriptor.block_ptr->increment();
-		descriptor.upcast_offset += val_detail::compute_upcast_offset<T, U>();
-	}
+	ptr(ptr<U, Threading> const & other) : ptr(other.descriptor.block_ptr, other.descriptor.upcast_offset + val_detail::compute_upcast_offset<T, U>()) {} //NOLINT(hicpp-explicit-conversions)
 
 	template <typename U, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
-	ptr& operator =(ptr<U> other) {
-		auto new_descriptor = other.get_descriptor();
-		new_descriptor.block_ptr->increment();
-		new_descriptor.upcast_offset += val_detail::compute_upcast_offset<T, U>();
-		auto old_descriptor = exchange_descriptor(new_descriptor);
-		old_descriptor.block_ptr->decrement();
+	ptr& operator =(ptr<U, Threading> const & other) {
+		ptr converted(other);
+		std::swap(descriptor, converted.descriptor);
 		return *this;
 	}
 
 	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
-	ptr(val<U, SmallStorageSizeU> const & other) { //NOLINT(hicpp-explicit-conversions)
-		descriptor = other.data.get_descriptor();
-		descriptor.block_ptr->increment();
-		descriptor.upcast_offset += val_detail::compute_upcast_offset<T, U>();
-	}
+	ptr(val<U, SmallStorageSizeU, Threading> const & other) : ptr(other.get_block(), other.upcast_offset + val_detail::compute_upcast_offset<T, U>()) {} //NOLINT(hicpp-explicit-conversions)
 
+	// downcast from val<U> where T inherits U, throwing std::bad_cast if the object is not a T
 	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<U, T>::value && !std::is_same<U, T>::value, int>::type = 0>
-	explicit ptr(val<U, SmallStorageSizeU> const & other) {
-		auto result = dynamic_cast<T*>(&*other);
-		if (result == nullptr) {
-			throw;
-		}
-		descriptor = other.data.get_descriptor();
-		descriptor.block_ptr->increment();
-		descriptor.upcast_offset -= val_detail::compute_upcast_offset<T, U>();
+	explicit ptr(val<U, SmallStorageSizeU, Threading> const & other) {
+		descriptor.upcast_offset = downcast_offset(other.object, other.op_ptr, &*other);
+		descriptor.block_ptr = other.get_block();
+		increment();
 	}
 
-	template <typename U, typename std::enable_if<std::is_base_of<U, T>::value, int>::type = 0>
-	explicit ptr(ptr<U> const & other) {
-		auto result = dynamic_cast<U*>(&*other);
-		descriptor = other.get_descriptor();
-		descriptor.block_ptr->increment();
-		descriptor.upcast_offset -= val_detail::compute_upcast_offset<T, U>();
-	}
+	// downcast from ptr<U> where T inherits U, throwing std::bad_cast if the object is not a T
+	template <typename U, typename std::enable_if<std::is_base_of<U, T>::value && !std::is_same<U, T>::value, int>::type = 0>
+	explicit ptr(ptr<U, Threading> const & other) : ptr(other.descriptor.block_ptr, downcast_offset(other.descriptor.block_ptr->data.load(std::memory_order_acquire), other.descriptor.block_ptr->op, &*other)) {}
 
+	// nullptr if expired
 	T* operator ->() const {
-		auto const d = get_descriptor();
-		auto const data = d.block_ptr->data.load();
-		auto result = reinterpret_cast<T *>(reinterpret_cast<int8_t *>(data) + d.upcast_offset);
-		return result;
+		// acquire pairs with the release store performed when the owning val relocates its object
+		auto const data = descriptor.block_ptr->data.load(std::memory_order_acquire);
+		if constexpr (val_detail::dangling == val_detail::dangling_policy::expire) {
+			if (data == nullptr) {
+				return nullptr;
+			}
+		}
+		return reinterpret_cast<T *>(static_cast<int8_t *>(data) + descriptor.upcast_offset);
 	}
 
 	T& operator *() const {
 		return *operator ->();
 	}
 
+	// true when the object has been destroyed, which a ptr only observes when VAL_DANGLING is VAL_DANGLING_EXPIRE
+	bool expired() const {
+		return descriptor.block_ptr->data.load(std::memory_order_acquire) == nullptr;
+	}
+
 private:
 	descriptor_t descriptor;
-	mutable std::mutex m;
 
 	explicit ptr(descriptor_t const & d) : descriptor(d) {
-		d.block_ptr->increment();
+		increment();
 	}
 
-	ptr(val_detail::block * b, size_t upcast_offset, val_detail::op_sig op_ptr) : descriptor{ b, upcast_offset, op_ptr } {
-		b->increment();
+	ptr(block * b, size_t upcast_offset) {
+		descriptor.upcast_offset = upcast_offset;
+		descriptor.block_ptr = b;
+		increment();
 	}
 
-	descriptor_t get_descriptor() const {
-		std::unique_lock<std::mutex> lock(m);
-		return descriptor;
+	void increment() {
+		val_detail::instrument<T>(val_instrumentation::event::ptr_increment, descriptor.block_ptr->op, 0);
+		descriptor.block_ptr->increment();
 	}
 
-	descriptor_t exchange_descriptor(descriptor_t const & v) {
-		std::unique_lock<std::mutex> lock(m);
-		const auto saved = descriptor;
-		descriptor = v;
-		return saved;
+	// the offset of the T subobject of object, whose U subobject is u, throwing std::bad_cast if object is not a T
+	// an object of exactly type T is recognized by its op table, only other types need dynamic_cast
+	template <typename U>
+	static size_t downcast_offset(void const * object, op_table const * op, U const * u) {
+		if (op == &val_detail::op_table_of<T>) {
+			return 0;
+		}
+		if constexpr (std::is_polymorphic<U>::value) {
+			auto const result = dynamic_cast<T const *>(u);
+			if (result != nullptr) {
+				return static_cast<size_t>(reinterpret_cast<int8_t const *>(result) - static_cast<int8_t const *>(object));
+			}
+		}
+		throw std::bad_cast();
 	}
 
-	descriptor_t clone(size_t upcast_offset, void * placement) const {
-		const auto d = get_descriptor();
-		if (placement == nullptr) {
-			char const * const uName = val_detail::type(d.op_ptr);
-			val_detail::emit_heap_warning<T>(uName);
+};
+
+namespace val_detail {
+
+	// the data members of val_base, which only stores the offset of the T subobject when it can be non-zero
+	template <size_t Size, size_t Alignment, bool IsZeroOffset>
+	struct val_members {
+		alignas(Alignment) unsigned char small_storage[Size > 0 ? Size : 1];
+		void * object = nullptr;
+		size_t upcast_offset = 0;
+		op_table const * op_ptr = nullptr;
+	};
+
+	template <size_t Size, size_t Alignment>
+	struct val_members<Size, Alignment, true> {
+		alignas(Alignment) unsigned char small_storage[Size > 0 ? Size : 1];
+		void * object = nullptr;
+		static constexpr zero_offset upcast_offset{};
+		op_table const * op_ptr = nullptr;
+	};
+
+	// the state shared by val and val_unique: small storage, the address and type of the erased object, and the offset of its T subobject
+	// the derived classes decide where objects that do not fit in small storage are allocated
+	template <typename T, size_t SmallStorageSize>
+	class val_base : protected val_members<SmallStorageSize, small_storage_alignment<T>, val_zero_upcast_offset<T>::value> {
+		using members = val_members<SmallStorageSize, val_detail::small_storage_alignment<T>, val_zero_upcast_offset<T>::value>;
+
+		template <typename, size_t>
+		friend class val_base;
+
+	public:
+		typedef T value_type;
+		static constexpr size_t small_storage_size = SmallStorageSize;
+		static constexpr size_t small_storage_alignment = val_detail::small_storage_alignment<T>;
+
+		static_assert(!val_detail::storage_hint_required<T>::value || val_detail::storage_hint<T>::size <= SmallStorageSize, "a type registered in val_storage_hint does not fit in small storage");
+		static_assert(!val_detail::storage_hint_required<T>::value || val_detail::storage_hint_nothrow_movable<T>::value, "a type registered in val_storage_hint is not nothrow move constructible, so it cannot be held in small storage");
+
+		T& operator *() { return *get(); }
+		T* operator ->() { return get(); }
+		T const& operator *() const { return *get(); }
+		T const* operator ->() const { return get(); }
+
+		std::unique_ptr<T> clone() const {
+			val_detail::instrument<T>(val_instrumentation::event::clone, op_ptr, SmallStorageSize);
+			auto const cloned = val_detail::clone(op_ptr, object, nullptr);
+			return std::unique_ptr<T>(reinterpret_cast<T*>(static_cast<int8_t*>(cloned) + upcast_offset));
 		}
-		const auto cloned = val_detail::clone(d.op_ptr, d.block_ptr->data.load(), placement);
-		return descriptor_t{ new block(cloned), d.upcast_offset + upcast_offset, d.op_ptr };
-	}
 
-	size_t get_size_of_data() const {
-		const auto d = get_descriptor();
-		return val_detail::size(d.op_ptr);
-	}
+		// true when the erased object lives in small_storage rather than on the heap
+		bool uses_small_storage() const {
+			return is_small();
+		}
 
-};
+		// call f with the object as the first of Ds that is exactly its dynamic type, or as a T when none of them is
+		// the dynamic type is identified by the address of its op table, so f is called directly and can be inlined
+		template <typename... Ds, typename F>
+		decltype(auto) visit(F && f) {
+			return visit_as<val_base, Ds...>(*this, std::forward<F>(f));
+		}
+
+		template <typename... Ds, typename F>
+		decltype(auto) visit(F && f) const {
+			return visit_as<val_base const, Ds...>(*this, std::forward<F>(f));
+		}
+
+		// true when the object is a U
+		// an object of exactly type U is recognized by comparing op table addresses, and dynamic_cast is only used to find
+		// U among the bases of another type
+		template <typename U>
+		bool holds() const {
+			return get_if<U>() != nullptr;
+		}
+
+		// the object as a U, or nullptr if it is not a U
+		template <typename U>
+		U * get_if() {
+			return const_cast<U *>(static_cast<val_base const &>(*this).template get_if<U>());
+		}
+
+		template <typename U>
+		U const * get_if() const {
+			if (object == nullptr) {
+				return nullptr;
+			}
+			if constexpr (std::is_base_of<U, T>::value) {
+				return get();
+			} else {
+				if (op_ptr == &op_table_of<U>) {
+					return static_cast<U const *>(object);
+				}
+				if constexpr (std::is_polymorphic<T>::value) {
+					return dynamic_cast<U const *>(get());
+				} else {
+					return nullptr;
+				}
+			}
+		}
+
+		// the std::hash of the object as its dynamic type, which throws std::logic_error if std::hash is not enabled for it
+		size_t hash() const {
+			return val_detail::hash(op_ptr, object);
+		}
+
+		// objects are equal when they have the same dynamic type and its operator == reports them equal
+		// the types are compared first, so objects of different types are unequal without calling into either type
+		// std::logic_error is thrown if the type has no operator ==
+		friend bool operator ==(val_base const & a, val_base const & b) {
+			return a.op_ptr == b.op_ptr && val_detail::equal(a.op_ptr, a.object, b.object);
+		}
+
+		friend bool operator !=(val_base const & a, val_base const & b) {
+			return !(a == b);
+		}
+
+		// objects of different dynamic types are ordered by std::type_info::before, and objects of the same type by its
+		// operator <, so that vals of mixed types can key ordered containers
+		// std::logic_error is thrown if the type has no operator <
+		friend bool operator <(val_base const & a, val_base const & b) {
+			if (a.op_ptr != b.op_ptr) {
+				return val_detail::type(a.op_ptr).before(val_detail::type(b.op_ptr));
+			}
+			return val_detail::less(a.op_ptr, a.object, b.object);
+		}
+
+		friend bool operator >(val_base const & a, val_base const & b) {
+			return b < a;
+		}
+
+		friend bool operator <=(val_base const & a, val_base const & b) {
+			return !(b < a);
+		}
+
+		friend bool operator >=(val_base const & a, val_base const & b) {
+			return !(a < b);
+		}
+
+	protected:
+		// small_storage is deliberately left uninitialized
+		val_base() = default; //NOLINT(hicpp-member-init)
+
+		val_base(size_t offset, op_table const * op) { //NOLINT(hicpp-member-init)
+			upcast_offset = offset;
+			op_ptr = op;
+		}
+
+		val_base(val_base const &) = delete;
+		val_base& operator =(val_base const &) = delete;
+		~val_base() = default;
+
+		// only types that can be relocated without throwing are placed in small_storage, so that moving is noexcept
+		static constexpr bool fits(size_t dataSize, size_t dataAlignment, bool nothrowMovable) {
+			return dataSize <= SmallStorageSize && dataAlignment <= small_storage_alignment && nothrowMovable;
+		}
+
+		static bool fits(op_table const * op) {
+			return fits(val_detail::size(op), val_detail::alignment(op), val_detail::nothrow_movable(op));
+		}
+
+		void * small_address() {
+			return static_cast<void *>(&small_storage);
+		}
+
+		bool is_small() const {
+			return object == static_cast<void const *>(&small_storage);
+		}
+
+		T * get() const {
+			return reinterpret_cast<T *>(static_cast<int8_t *>(object) + upcast_offset);
+		}
+
+		// report whether an object of type op was placed in small storage to val_instrumentation
+		void instrument_placement(void const * placement, op_table const * op) const {
+			bool const small = placement == static_cast<void const *>(&small_storage);
+			val_detail::instrument<T>(small ? val_instrumentation::event::small_storage_hit : val_instrumentation::event::heap_fallback, op, SmallStorageSize);
+		}
+
+		// copy assign the object of other over the object of this, if both have the same dynamic type and T subobject
+		template <typename U, size_t SmallStorageSizeU>
+		bool assign_in_place(val_base<U, SmallStorageSizeU> const & other, size_t otherUpcastOffset) {
+			return object != nullptr && other.object != nullptr && op_ptr == other.op_ptr && upcast_offset == otherUpcastOffset && val_detail::assign(op_ptr, other.object, object);
+		}
+
+	private:
+		template <typename Self, typename F>
+		static decltype(auto) visit_as(Self & self, F && f) {
+			return std::forward<F>(f)(*self.get());
+		}
+
+		template <typename Self, typename D, typename... Ds, typename F>
+		static decltype(auto) visit_as(Self & self, F && f) {
+			static_assert(std::is_base_of<T, D>::value, "visited types must be or inherit T");
+			typedef decltype(std::forward<F>(f)(*self.get())) result_type;
+			typedef typename std::conditional<std::is_const<Self>::value, D const, D>::type visited_type;
+			if (self.op_ptr == &op_table_of<D>) {
+				return static_cast<result_type>(std::forward<F>(f)(*static_cast<visited_type *>(self.object)));
+			}
+			return static_cast<result_type>(visit_as<Self, Ds...>(self, std::forward<F>(f)));
+		}
+
+		using members::small_storage;
+
+	protected:
+		using members::object;
+		using members::upcast_offset;
+		using members::op_ptr;
+	};
+
+}
 
 // value semantic type erasure via base types
-template<typename T, size_t SmallStorageSize = val_detail::small_storage_size<16, T>>
-class val {  // NOLINT(cppcoreguidelines-special-member-functions, cppcoreguidelines-special-member-functions, hicpp-special-member-functions)
-	template <typename>
+// Threading selects whether the val and its ptrs may be used from different threads, see ptr
+template<typename T, size_t SmallStorageSize = val_detail::small_storage_size<16, T>, typename Threading = val_multi_threaded>
+class val : public val_detail::val_base<T, SmallStorageSize> {  // NOLINT(cppcoreguidelines-special-member-functions, cppcoreguidelines-special-member-functions, hicpp-special-member-functions)
+	template <typename, typename>
 	friend class ptr;
 
-	template <typename, size_t>
+	template <typename, size_t, typename>
 	friend class val;
 
-	using descriptor_t = val_detail::descriptor_t;
-	using block = val_detail::block;
-	using op_sig = val_detail::block;
+	using base = val_detail::val_base<T, SmallStorageSize>;
+	using block = val_detail::block<Threading>;
+	using op_table = val_detail::op_table;
+	using storage = val_detail::storage<Threading>;
+
+	using base::object;
+	using base::upcast_offset;
+	using base::op_ptr;
+	using base::fits;
+	using base::small_address;
+	using base::is_small;
+	using base::assign_in_place;
+	using base::instrument_placement;
+
+	storage allocate(op_table const * op, std::pmr::memory_resource * resource) {
+		if (fits(op)) {
+			return storage{ small_address(), nullptr };
+		}
+		return val_detail::allocate_colocated<Threading>(op, resource);
+	}
 
-	void * emplacement_ptr(size_t dataSize) {
-		return nullptr;
-		if (dataSize <= SmallStorageSize) {
-			return reinterpret_cast<void *>(&small_storage);
+	// free storage from allocate() that does not hold an object
+	static void deallocate(storage const & s) noexcept {
+		if (s.block_ptr != nullptr) {
+			s.block_ptr->deallocate(s.block_ptr);
 		}
-		return nullptr;
 	}
 
-	template <typename U>
-	typename std::remove_const<U>::type * construct(U const & other) {
-		const auto ptr = emplacement_ptr(sizeof(U));
-		if (ptr == nullptr) {
-			val_detail::emit_heap_warning2<T, U>();
-			return new typename std::remove_const<U>::type(other);
+	// construct a U into this empty val
+	template <typename U, typename... ArgTs>
+	void construct(ArgTs &&... args) {
+		construct_in<U>(nullptr, std::forward<ArgTs>(args)...);
+	}
+
+	// construct a U into this empty val, allocating from resource if it does not fit in small storage
+	template <typename U, typename... ArgTs>
+	void construct_in(std::pmr::memory_resource * resource, ArgTs &&... args) {
+		auto const s = allocate(&val_detail::op_table_of<U>, resource);
+		instrument_placement(s.placement, &val_detail::op_table_of<U>);
+		if (s.placement == nullptr) {
+			object = new U(std::forward<ArgTs>(args)...);
+		} else {
+			try {
+				object = val_detail::placement_construct<U>(s.placement, std::forward<ArgTs>(args)...);
+			} catch (...) {
+				deallocate(s);
+				throw;
+			}
 		}
-		return val_detail::placement_copy<U>(other, ptr);
+		upcast_offset = val_detail::compute_upcast_offset<T, U>();
+		op_ptr = &val_detail::op_table_of<U>;
+		tracker.store(s.block_ptr, std::memory_order_relaxed);
 	}
 
-	template <typename U, typename std::enable_if<std::is_move_constructible<U>::value, int>::type = 0>
-	typename std::remove_const<U>::type * construct(U && other) {
-		const auto ptr = emplacement_ptr(sizeof(U));
-		if (ptr == nullptr) {
-			val_detail::emit_heap_warning2<T, U>();
-			return new U(std::forward<U>(other));
+	// clone the erased object of another val into this empty val, using the op_ptr of this val
+	void clone_from(void const * source, std::pmr::memory_resource * resource = nullptr) {
+		auto const s = allocate(op_ptr, resource);
+		instrument_placement(s.placement, op_ptr);
+		val_detail::instrument<T>(val_instrumentation::event::clone, op_ptr, SmallStorageSize);
+		try {
+			object = val_detail::clone(op_ptr, source, s.placement);
+		} catch (...) {
+			deallocate(s);
+			throw;
 		}
-		return val_detail::placement_move<U>(std::forward<U>(other), ptr);
+		tracker.store(s.block_ptr, std::memory_order_relaxed);
 	}
 
-	template <typename U>
-	explicit val(U * v) : small_storage(), data(new val_detail::block(v), val_detail::compute_upcast_offset<T, U>(), &val_detail::op<U>) {}
+	// take the erased object of other into this empty val, leaving other empty
+	// heap objects are stolen along with their block, objects in small storage are relocated
+	template <typename U, size_t SmallStorageSizeU>
+	void steal_from(val<U, SmallStorageSizeU, Threading> & other) {
+		if (!other.is_small()) {
+			object = other.object;
+			tracker.store(other.tracker.exchange(nullptr, std::memory_order_acq_rel), std::memory_order_release);
+			other.object = nullptr;
+			return;
+		}
+		storage s{ small_address(), nullptr };
+		if (!std::is_same<val, val<U, SmallStorageSizeU, Threading>>::value && !fits(other.op_ptr)) {
+			// outstanding ptrs of other already use a separate block, so a co-located one would be redundant
+			s = other.tracker.load(std::memory_order_acquire) == nullptr ? val_detail::allocate_colocated<Threading>(other.op_ptr) : storage{ nullptr, nullptr };
+		}
+		if (!std::is_same<val, val<U, SmallStorageSizeU, Threading>>::value) {
+			instrument_placement(s.placement, other.op_ptr);
+		}
+		object = val_detail::move(other.op_ptr, other.object, s.placement);
+		other.object = nullptr;
+		block * b = other.tracker.exchange(nullptr, std::memory_order_acq_rel);
+		if (b != nullptr) {
+			// outstanding ptrs follow the object
+			b->data.store(object, std::memory_order_release);
+		} else {
+			b = s.block_ptr;
+		}
+		tracker.store(b, std::memory_order_release);
+	}
 
-public:
-	typedef T value_type;
-	static constexpr size_t small_storage_size = SmallStorageSize;
+	// destroy the erased object, leaving this val empty
+	// what happens to ptrs that still refer to the object is selected by VAL_DANGLING
+	void release() noexcept {
+		block * const b = tracker.load(std::memory_order_acquire);
+		tracker.store(nullptr, std::memory_order_relaxed);
+		if (b != nullptr) {
+			if constexpr (val_detail::dangling == val_detail::dangling_policy::abort) {
+				// acquire pairs with the release decrements of ptrs that were destroyed on other threads
+				intptr_t const count = b->count.load(std::memory_order_acquire);
+				if (count != 1) {
+					val_detail::abort_dangling("val", count - 1);
+				}
+			} else if constexpr (val_detail::dangling == val_detail::dangling_policy::expire) {
+				b->data.store(nullptr, std::memory_order_release);
+			}
+		}
+		if (object != nullptr) {
+			if (is_small() || val_detail::is_colocated(b)) {
+				val_detail::destruct(op_ptr, object);
+			} else {
+				val_detail::delete_(op_ptr, object);
+			}
+			object = nullptr;
+		}
+		if (b != nullptr) {
+			if constexpr (val_detail::dangling == val_detail::dangling_policy::expire) {
+				// expired ptrs keep the block, and any co-located object storage, until the last of them is destroyed
+				b->decrement();
+			} else {
+				// this val holds the only reference, and freeing the block frees co-located object storage
+				b->deallocate(b);
+			}
+		}
+	}
 
-	// ReSharper disable CppPossiblyUninitializedMember
+	// the block of an object in small storage is only allocated once a ptr is taken from this val
+	block * get_block() const {
+		block * result = tracker.load(std::memory_order_acquire);
+		if (result == nullptr) {
+			auto const fresh = val_detail::allocate_block<Threading>(object, op_ptr);
+			fresh->increment(); // the reference held by this val
+			if (tracker.compare_exchange_strong(result, fresh, std::memory_order_acq_rel, std::memory_order_acquire)) {
+				result = fresh;
+			} else {
+				fresh->deallocate(fresh);
+			}
+		}
+		return result;
+	}
+
+public:
 	// ReSharper disable CppNonExplicitConvertingConstructor
-	val(T const & v) : val(construct(v)) {} //NOLINT(hicpp-member-init, hicpp-explicit-conversions)
+	val(T const & v) { //NOLINT(hicpp-explicit-conversions)
+		construct<T>(v);
+	}
 
-	val(T && v) : val(construct(std::forward<T>(v))) {} //NOLINT(hicpp-member-init, hicpp-explicit-conversions)
+	val(T && v) { //NOLINT(hicpp-explicit-conversions)
+		construct<T>(std::forward<T>(v));
+	}
 
-	val(val const & other) : small_storage(), data(other.data.clone(0, emplacement_ptr(SmallStorageSize))) {}
+	val(val const & other) : base(other.upcast_offset, other.op_ptr) {
+		clone_from(other.object);
+	}
 
-	explicit val(T * v) : small_storage(), data(new val_detail::block(v), 0, &val_detail::op<T>) {}
+	// the moved-from val is left empty; it may only be assigned to or destroyed
+	val(val && other) noexcept : base(other.upcast_offset, other.op_ptr) {
+		steal_from(other);
+	}
+
+	// adopt a heap allocated object
+	explicit val(T * v) : base(0, &val_detail::op_table_of<T>) {
+		if (v == nullptr) {
+			throw std::invalid_argument("val::val(T *) received a nullptr");
+		}
+		object = v;
+	}
+
+	// construct a U that is or inherits T directly in the storage of this val
+	template <typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	explicit val(std::in_place_type_t<U>, ArgTs &&... args) {
+		construct<U>(std::forward<ArgTs>(args)...);
+	}
+
+	// construct a U that is or inherits T, allocating from resource if it does not fit in small storage
+	// the object and its block share one allocation from resource, which is returned to resource when the last ptr is released
+	template <typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	val(std::allocator_arg_t, std::pmr::memory_resource * resource, std::in_place_type_t<U>, ArgTs &&... args) {
+		construct_in<U>(resource, std::forward<ArgTs>(args)...);
+	}
+
+	// copy, allocating from resource if the object does not fit in small storage
+	// as with std::pmr containers, the plain copy constructor does not propagate the memory resource of other
+	val(std::allocator_arg_t, std::pmr::memory_resource * resource, val const & other) : base(other.upcast_offset, other.op_ptr) {
+		clone_from(other.object, resource);
+	}
 	
 	// construct from type U that inherits T
 	template <typename U, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
-	val(U const & v) : val(construct(v)) {} //NOLINT(hicpp-member-init, hicpp-explicit-conversions)
+	val(U const & v) { //NOLINT(hicpp-explicit-conversions)
+		construct<U>(v);
+	}
 
 	// construct from type U that inherits T
 	template <typename U, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
 	// ReSharper disable once CppNonExplicitConvertingConstructor
-	val(U && v) : val(construct(std::forward<U>(v))) {} //NOLINT(misc-forwarding-reference-overload, hicpp-member-init, hicpp-explicit-conversions)
+	val(U && v) { //NOLINT(misc-forwarding-reference-overload, hicpp-explicit-conversions)
+		construct<U>(std::forward<U>(v));
+	}
 
 	// construct from val<U> where U inherits T
 	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
-	val(val<U, SmallStorageSizeU> const & other) : small_storage(), data(other.data.clone(val_detail::compute_upcast_offset<T, U>(), emplacement_ptr(other.data.get_size_of_data()))) {} //NOLINT(hicpp-explicit-conversions)
+	val(val<U, SmallStorageSizeU, Threading> const & other) : base(other.upcast_offset + val_detail::compute_upcast_offset<T, U>(), other.op_ptr) { //NOLINT(hicpp-explicit-conversions)
+		clone_from(other.object);
+	}
 
-	// construct from val<U> where U inherits T
+	// move from val<U> where U inherits T
+	// this only allocates when the object of other is in small storage and does not fit in the small storage of this val
+	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<val, val<U, SmallStorageSizeU, Threading>>::value, int>::type = 0>
+	val(val<U, SmallStorageSizeU, Threading> && other) : base(other.upcast_offset + val_detail::compute_upcast_offset<T, U>(), other.op_ptr) { //NOLINT(hicpp-explicit-conversions)
+		steal_from(other);
+	}
+
+	// construct from val<U> where T inherits U
 	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<U, T>::value && !std::is_same<T, U>::value, int>::type = 0>
-	explicit val(val<U, SmallStorageSizeU> const & other) : small_storage(), data(other.data.clone(val_detail::compute_upcast_offset<T, U>(), emplacement_ptr(other.data.get_size_of_data()))) {}
+	explicit val(val<U, SmallStorageSizeU, Threading> const & other) : base(other.upcast_offset + val_detail::compute_upcast_offset<T, U>(), other.op_ptr) {
+		clone_from(other.object);
+	}
 
-	// ReSharper restore CppPossiblyUninitializedMember
 	// ReSharper restore CppNonExplicitConvertingConstructor
 
 	~val() noexcept {
-		auto d = data.get_descriptor();
-		auto & b = *d.block_ptr;
-		// b.data and b.count are sequentially consistent
-		void * buffer = b.data.exchange(nullptr);
-		if (b.count != 1) {
-			std::cerr << "Destruction of a val with " << (b.count - 1) << "dangling ptr(s). Aborting!" << std::endl;
-			abort();
-		}
-		if (buffer == &small_storage) {
-			val_detail::destruct(d.op_ptr, buffer);
-		} else {
-			val_detail::delete_(d.op_ptr, buffer);
+		release();
+	}
+
+	// reuses the existing storage when the dynamic types match and val_assign_in_place, in which case outstanding ptrs
+	// remain valid
+	val& operator =(val const & other) {
+		if (!assign_in_place(other, other.upcast_offset)) {
+			*this = val(other);
 		}
+		return *this;
 	}
 
-	T& operator *() { return *data; }
-	T* operator ->() {
-		T * const result = &*data;
-		return result;
+	val& operator =(val && other) noexcept {
+		if (this != &other) {
+			release();
+			upcast_offset = other.upcast_offset;
+			op_ptr = other.op_ptr;
+			steal_from(other);
+		}
+		return *this;
 	}
-	T const& operator *() const { return *data; }
-	T const* operator ->() const { return &*data; }
 
-	std::unique_ptr<T> clone() const {
-		auto d = data.clone(0, nullptr);
-		return std::unique_ptr<T>(reinterpret_cast<T*>(static_cast<int8_t*>(d.block_ptr->data.load()) + d.upcast_offset));
+	// assign from val<U> where U inherits T
+	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	val& operator =(val<U, SmallStorageSizeU, Threading> const & other) {
+		if (!assign_in_place(other, other.upcast_offset + val_detail::compute_upcast_offset<T, U>())) {
+			*this = val(other);
+		}
+		return *this;
+	}
+
+	// move assign from val<U> where U inherits T
+	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<val, val<U, SmallStorageSizeU, Threading>>::value, int>::type = 0>
+	val& operator =(val<U, SmallStorageSizeU, Threading> && other) {
+		*this = val(std::move(other));
+		return *this;
+	}
+
+	// destroy the current object and construct a U that is or inherits T in its place
+	// if the constructor of U throws, this val is left empty
+	template <typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	U& emplace(ArgTs &&... args) {
+		release();
+		construct<U>(std::forward<ArgTs>(args)...);
+		return *static_cast<U *>(object);
+	}
+
+	// the memory resource that provided the heap storage of the object, or nullptr for the global operator new
+	std::pmr::memory_resource * memory_resource() const {
+		return is_small() ? nullptr : val_detail::resource_of(tracker.load(std::memory_order_acquire));
+	}
+
+	// an upper bound on the bytes that copying this val with a memory resource allocates from it, including alignment padding
+	// zero when the copy is placed in small storage
+	size_t copy_resource_bytes() const {
+		if (object == nullptr || fits(op_ptr)) {
+			return 0;
+		}
+		size_t const alignment = val_detail::alignment(op_ptr);
+		size_t const blockAlignment = std::max(alignment, alignof(val_detail::resource_block<Threading>));
+		return val_detail::colocated_offset<val_detail::resource_block<Threading>>(alignment) + val_detail::size(op_ptr) + blockAlignment - 1;
 	}
 
 private:
-	int8_t small_storage[SmallStorageSize];
-	ptr<T> data;
+	mutable typename Threading::template cell<block *> tracker{ nullptr };
 
 };
 
+// value semantic type erasure via base types, without support for ptr
+// objects that do not fit in small storage get a plain heap allocation, and construction and destruction use no atomics
+// when Copyable is false, copying is deleted, so holding a type that cannot be copy constructed is never a runtime error;
+// otherwise copying such a type throws std::logic_error
+template<typename T, size_t SmallStorageSize = val_detail::small_storage_size<16, T>, bool Copyable = true>
+class val_unique : public val_detail::val_base<T, SmallStorageSize> {  // NOLINT(cppcoreguidelines-special-member-functions, hicpp-special-member-functions)
+	template <typename, size_t, bool>
+	friend class val_unique;
+
+	using base = val_detail::val_base<T, SmallStorageSize>;
+
+	// the parameter of the copy constructor and copy assignment, which are implicitly deleted when they take no_copy_source
+	typedef typename std::conditional<Copyable, val_unique, val_detail::no_copy_source>::type copy_source;
+
+	using base::object;
+	using base::upcast_offset;
+	using base::op_ptr;
+	using base::fits;
+	using base::small_address;
+	using base::is_small;
+	using base::assign_in_place;
+	using base::instrument_placement;
+
+	// construct a U into this empty val_unique
+	template <typename U, typename... ArgTs>
+	void construct(ArgTs &&... args) {
+		if (fits(sizeof(U), alignof(U), std::is_nothrow_move_constructible<U>::value)) {
+			instrument_placement(small_address(), &val_detail::op_table_of<U>);
+			object = val_detail::placement_construct<U>(small_address(), std::forward<ArgTs>(args)...);
+		} else {
+			instrument_placement(nullptr, &val_detail::op_table_of<U>);
+			object = new U(std::forward<ArgTs>(args)...);
+		}
+		upcast_offset = val_detail::compute_upcast_offset<T, U>();
+		op_ptr = &val_detail::op_table_of<U>;
+	}
+
+	// clone the erased object of another val_unique into this empty val_unique, using the op_ptr of this val_unique
+	void clone_from(void const * source) {
+		void * const placement = fits(op_ptr) ? small_address() : nullptr;
+		instrument_placement(placement, op_ptr);
+		val_detail::instrument<T>(val_instrumentation::event::clone, op_ptr, SmallStorageSize);
+		object = val_detail::clone(op_ptr, source, placement);
+	}
+
+	// take the erased object of other into this empty val_unique, leaving other empty
+	template <typename U, size_t SmallStorageSizeU, bool CopyableU>
+	void steal_from(val_unique<U, SmallStorageSizeU, CopyableU> & other) {
+		if (!other.is_small()) {
+			object = other.object;
+		} else {
+			void * const placement = std::is_same<val_unique, val_unique<U, SmallStorageSizeU, CopyableU>>::value || fits(other.op_ptr) ? small_address() : nullptr;
+			if (!std::is_same<val_unique, val_unique<U, SmallStorageSizeU, CopyableU>>::value) {
+				instrument_placement(placement, other.op_ptr);
+			}
+			object = val_detail::move(other.op_ptr, other.object, placement);
+		}
+		other.object = nullptr;
+	}
+
+	// destroy the erased object, leaving this val_unique empty
+	void release() noexcept {
+		if (object == nullptr) {
+			return;
+		}
+		if (is_small()) {
+			val_detail::destruct(op_ptr, object);
+		} else {
+			val_detail::delete_(op_ptr, object);
+		}
+		object = nullptr;
+	}
+
+public:
+	// ReSharper disable CppNonExplicitConvertingConstructor
+	val_unique(T const & v) { //NOLINT(hicpp-explicit-conversions)
+		construct<T>(v);
+	}
+
+	val_unique(T && v) { //NOLINT(hicpp-explicit-conversions)
+		construct<T>(std::forward<T>(v));
+	}
+
+	val_unique(copy_source const & other) : base(other.upcast_offset, other.op_ptr) { //NOLINT(hicpp-explicit-conversions)
+		clone_from(other.object);
+	}
+
+	// the moved-from val_unique is left empty; it may only be assigned to or destroyed
+	val_unique(val_unique && other) noexcept : base(other.upcast_offset, other.op_ptr) {
+		steal_from(other);
+	}
+
+	// adopt a heap allocated object
+	explicit val_unique(T * v) : base(0, &val_detail::op_table_of<T>) {
+		if (v == nullptr) {
+			throw std::invalid_argument("val_unique::val_unique(T *) received a nullptr");
+		}
+		object = v;
+	}
+
+	// construct a U that is or inherits T directly in the storage of this val_unique
+	template <typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	explicit val_unique(std::in_place_type_t<U>, ArgTs &&... args) {
+		construct<U>(std::forward<ArgTs>(args)...);
+	}
+
+	// construct from type U that inherits T
+	template <typename U, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+	val_unique(U const & v) { //NOLINT(hicpp-explicit-conversions)
+		construct<U>(v);
+	}
+
+	// construct from type U that inherits T
+	template <typename U, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+	val_unique(U && v) { //NOLINT(misc-forwarding-reference-overload, hicpp-explicit-conversions)
+		construct<U>(std::forward<U>(v));
+	}
+
+	// construct from val_unique<U> where U inherits T
+	template <typename U, size_t SmallStorageSizeU, bool CopyableU, typename std::enable_if<std::is_base_of<T, U>::value && Copyable && CopyableU, int>::type = 0>
+	val_unique(val_unique<U, SmallStorageSizeU, CopyableU> const & other) : base(other.upcast_offset + val_detail::compute_upcast_offset<T, U>(), other.op_ptr) { //NOLINT(hicpp-explicit-conversions)
+		clone_from(other.object);
+	}
+
+	// move from val_unique<U> where U inherits T; a val_move_only only moves into a val_move_only
+	template <typename U, size_t SmallStorageSizeU, bool CopyableU, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<val_unique, val_unique<U, SmallStorageSizeU, CopyableU>>::value && (!Copyable || CopyableU), int>::type = 0>
+	val_unique(val_unique<U, SmallStorageSizeU, CopyableU> && other) : base(other.upcast_offset + val_detail::compute_upcast_offset<T, U>(), other.op_ptr) { //NOLINT(hicpp-explicit-conversions)
+		steal_from(other);
+	}
+
+	// construct from val_unique<U> where T inherits U
+	template <typename U, size_t SmallStorageSizeU, bool CopyableU, typename std::enable_if<std::is_base_of<U, T>::value && !std::is_same<T, U>::value && Copyable && CopyableU, int>::type = 0>
+	explicit val_unique(val_unique<U, SmallStorageSizeU, CopyableU> const & other) : base(other.upcast_offset + val_detail::compute_upcast_offset<T, U>(), other.op_ptr) {
+		clone_from(other.object);
+	}
+
+	// ReSharper restore CppNonExplicitConvertingConstructor
+
+	~val_unique() noexcept {
+		release();
+	}
+
+	val_unique& operator =(copy_source const & other) {
+		if (!assign_in_place(other, other.upcast_offset)) {
+			*this = val_unique(other);
+		}
+		return *this;
+	}
+
+	val_unique& operator =(val_unique && other) noexcept {
+		if (this != &other) {
+			release();
+			upcast_offset = other.upcast_offset;
+			op_ptr = other.op_ptr;
+			steal_from(other);
+		}
+		return *this;
+	}
+
+	// assign from val_unique<U> where U inherits T
+	template <typename U, size_t SmallStorageSizeU, bool CopyableU, typename std::enable_if<std::is_base_of<T, U>::value && Copyable && CopyableU, int>::type = 0>
+	val_unique& operator =(val_unique<U, SmallStorageSizeU, CopyableU> const & other) {
+		if (!assign_in_place(other, other.upcast_offset + val_detail::compute_upcast_offset<T, U>())) {
+			*this = val_unique(other);
+		}
+		return *this;
+	}
+
+	// move assign from val_unique<U> where U inherits T
+	template <typename U, size_t SmallStorageSizeU, bool CopyableU, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<val_unique, val_unique<U, SmallStorageSizeU, CopyableU>>::value && (!Copyable || CopyableU), int>::type = 0>
+	val_unique& operator =(val_unique<U, SmallStorageSizeU, CopyableU> && other) {
+		*this = val_unique(std::move(other));
+		return *this;
+	}
+
+	// destroy the current object and construct a U that is or inherits T in its place
+	// if the constructor of U throws, this val_unique is left empty
+	template <typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	U& emplace(ArgTs &&... args) {
+		release();
+		construct<U>(std::forward<ArgTs>(args)...);
+		return *static_cast<U *>(object);
+	}
+
+	// a copy of the object on the heap, which is only available when Copyable
+	template <bool CopyableT = Copyable, typename std::enable_if<CopyableT, int>::type = 0>
+	std::unique_ptr<T> clone() const {
+		return base::clone();
+	}
+
+};
+
+// a val without small storage only refers to its heap object and block, neither of which refers back to the val
+template <typename T, typename Threading>
+struct val_is_trivially_relocatable<val<T, 0, Threading>> : std::true_type {};
+
+template <typename T, bool Copyable>
+struct val_is_trivially_relocatable<val_unique<T, 0, Copyable>> : std::true_type {};
+
+// relocate [first, last) to the uninitialized storage at dest, leaving [first, last) uninitialized
+// dest may overlap [first, last) when dest <= first; when dest == first, the objects are already in place
+// trivially relocatable types are copied in one block, other types are moved and destroyed one at a time
+template <typename T>
+T * val_relocate(T * first, T * last, T * dest) noexcept {
+	static_assert(val_is_trivially_relocatable<T>::value || std::is_nothrow_move_constructible<T>::value, "val_relocate requires trivially relocatable or nothrow move constructible types");
+	if constexpr (val_is_trivially_relocatable<T>::value) {
+		std::memmove(static_cast<void *>(dest), static_cast<void const *>(first), static_cast<size_t>(last - first) * sizeof(T));
+		return dest + (last - first);
+	} else {
+		if (dest == first) {
+			return last;
+		}
+		for (; first != last; ++first, ++dest) {
+			new (static_cast<void *>(dest)) T(std::move(*first));
+			first->~T();
+		}
+		return dest;
+	}
+}
+
+// the heap objects of vals are relocated by copying the val, only objects in small storage are moved
+template <typename T, size_t SmallStorageSize, typename Threading, typename std::enable_if<(SmallStorageSize > 0), int>::type = 0>
+val<T, SmallStorageSize, Threading> * val_relocate(val<T, SmallStorageSize, Threading> * first, val<T, SmallStorageSize, Threading> * last, val<T, SmallStorageSize, Threading> * dest) noexcept {
+	typedef val<T, SmallStorageSize, Threading> val_type;
+	if (dest == first) {
+		return last;
+	}
+	for (; first != last; ++first, ++dest) {
+		if (first->uses_small_storage()) {
+			new (static_cast<void *>(dest)) val_type(std::move(*first));
+			first->~val_type();
+		} else {
+			std::memmove(static_cast<void *>(dest), static_cast<void const *>(first), sizeof(val_type));
+		}
+	}
+	return dest;
+}
+
 template <typename T, typename... ArgTs>
 val<T> make_val(ArgTs &&... args) {
-	return val<T>(T(std::forward<ArgTs>(args)...));
+	return val<T>(std::in_place_type<T>, std::forward<ArgTs>(args)...);
+}
+
+// construct a U that inherits T directly in a val<T>
+template <typename T, typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+val<T> make_val(ArgTs &&... args) {
+	return val<T>(std::in_place_type<U>, std::forward<ArgTs>(args)...);
+}
+
+// construct a T in a val<T>, allocating from resource if it does not fit in small storage
+template <typename T, typename... ArgTs>
+val<T> allocate_val(std::pmr::memory_resource * resource, ArgTs &&... args) {
+	return val<T>(std::allocator_arg, resource, std::in_place_type<T>, std::forward<ArgTs>(args)...);
+}
+
+// construct a U that inherits T in a val<T>, allocating from resource if it does not fit in small storage
+template <typename T, typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+val<T> allocate_val(std::pmr::memory_resource * resource, ArgTs &&... args) {
+	return val<T>(std::allocator_arg, resource, std::in_place_type<U>, std::forward<ArgTs>(args)...);
+}
+
+template <typename T, typename... ArgTs>
+val_unique<T> make_val_unique(ArgTs &&... args) {
+	return val_unique<T>(std::in_place_type<T>, std::forward<ArgTs>(args)...);
+}
+
+// construct a U that inherits T directly in a val_unique<T>
+template <typename T, typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+val_unique<T> make_val_unique(ArgTs &&... args) {
+	return val_unique<T>(std::in_place_type<U>, std::forward<ArgTs>(args)...);
 }
 
 template <typename T>
@@ -457,4 +1657,31 @@ val<T> VAL(T const & v) {
 	return val<T>(v);
 }
 
+// call f with the object of v as the first of the closed set of types Ds that is exactly its dynamic type, or as the
+// base type of v when none of them is
+// v may be a val, val_unique or val_cow
+template <typename... Ds, typename V, typename F, typename std::enable_if<std::is_base_of<val_detail::val_base<typename std::decay<V>::type::value_type, std::decay<V>::type::small_storage_size>, typename std::decay<V>::type>::value, int>::type = 0>
+decltype(auto) visit(V && v, F && f) {
+	return std::forward<V>(v).template visit<Ds...>(std::forward<F>(f));
+}
+
+namespace std {
+
+	// hashes the object of a val as its dynamic type, see val_base::hash
+	template <typename T, size_t SmallStorageSize, typename Threading>
+	struct hash<val<T, SmallStorageSize, Threading>> {
+		size_t operator()(val<T, SmallStorageSize, Threading> const & v) const {
+			return v.hash();
+		}
+	};
+
+	template <typename T, size_t SmallStorageSize, bool Copyable>
+	struct hash<val_unique<T, SmallStorageSize, Copyable>> {
+		size_t operator()(val_unique<T, SmallStorageSize, Copyable> const & v) const {
+			return v.hash();
+		}
+	};
+
+}
+
 #endif // INCLUDED_UTILITIES_VAL_HPP
@@ -0,0 +1,217 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_ATOMIC_HPP
+#define INCLUDED_UTILITIES_VAL_ATOMIC_HPP
+
+#include "val.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <thread>
+
+namespace val_detail {
+
+	// epoch based reclamation shared by every atomic_val
+	// a reading thread publishes the epoch in which it started reading, and an object that was unpublished in epoch e is
+	// destroyed once every reading thread started in e or later
+	namespace epoch {
+
+		// the reading state of one thread, on its own cache line so that readers never write a shared one
+		struct alignas(64) record {
+			std::atomic<uint64_t> epoch{ 0 }; // 0 while the thread is not reading
+			std::atomic<bool> in_use{ true }; // false once the thread has exited, so that another can take the record
+			record * next = nullptr; // set before the record is published, and never changed
+			size_t depth = 0; // the number of read guards held by the owning thread
+		};
+
+		struct domain {
+			std::atomic<uint64_t> epoch{ 1 };
+			std::atomic<record *> records{ nullptr }; // records are never freed, only reused
+		};
+
+		inline domain global_domain;
+
+		inline record * acquire_record() {
+			for (record * r = global_domain.records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+				bool expected = false;
+				if (!r->in_use.load(std::memory_order_relaxed) && r->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+					return r;
+				}
+			}
+			auto const r = new record();
+			r->next = global_domain.records.load(std::memory_order_relaxed);
+			while (!global_domain.records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {}
+			return r;
+		}
+
+		// the record of the calling thread, which is released for reuse when the thread exits
+		inline record & this_thread_record() {
+			thread_local struct owner {
+				record * const r = acquire_record();
+				~owner() { r->in_use.store(false, std::memory_order_release); }
+			} o;
+			return *o.r;
+		}
+
+		inline void enter(record & r) {
+			if (r.depth++ == 0) {
+				// seq_cst orders this store before the load of the published object, and the load of the epoch after
+				// the advance that produced it, so a reader that observes an epoch also observes the replacement of every
+				// object that was unpublished before that advance
+				r.epoch.store(global_domain.epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+			}
+		}
+
+		inline void leave(record & r) noexcept {
+			if (--r.depth == 0) {
+				// release orders the reads of the object before its reclamation
+				r.epoch.store(0, std::memory_order_release);
+			}
+		}
+
+		// begin a new epoch after an object was unpublished, returning the epoch in which it may be destroyed
+		inline uint64_t advance() {
+			return global_domain.epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+		}
+
+		// the oldest epoch in which a thread that is still reading started
+		inline uint64_t oldest_reader() {
+			uint64_t result = std::numeric_limits<uint64_t>::max();
+			for (record * r = global_domain.records.load(std::memory_order_acquire); r != nullptr; r = r->next) {
+				uint64_t const e = r->epoch.load(std::memory_order_seq_cst);
+				if (e != 0 && e < result) {
+					result = e;
+				}
+			}
+			return result;
+		}
+
+		// wait until every thread that is reading started in epoch e or later
+		inline void synchronize(uint64_t e) {
+			while (oldest_reader() < e) {
+				std::this_thread::yield();
+			}
+		}
+
+	}
+
+}
+
+// a val that is replaced by writers while any number of reader threads access it
+// load is wait-free and only writes to a cache line of the calling thread, and a replaced object is destroyed once no
+// reader can still be accessing it; writers share a mutex to track replaced objects, readers never take it
+// the object is only accessed as const through a read guard, and a thread must not replace the object while it holds one
+template <typename T, size_t SmallStorageSize = val_detail::small_storage_size<16, T>>
+class atomic_val {
+public:
+	typedef val<T, SmallStorageSize> val_type;
+
+private:
+	struct node {
+		explicit node(val_type && v) : value(std::move(v)), next(nullptr), epoch(0) {}
+		val_type value;
+		node * next; // the next retired node
+		uint64_t epoch; // the epoch in which this retired node may be destroyed
+	};
+
+public:
+	// const access to the object that was published when it was constructed
+	// the object remains valid while the read guard exists, even if it is replaced
+	class read_guard {
+		friend class atomic_val;
+
+	public:
+		read_guard(read_guard const &) = delete;
+		read_guard& operator =(read_guard const &) = delete;
+
+		~read_guard() {
+			val_detail::epoch::leave(reader);
+		}
+
+		T const& operator *() const { return *object; }
+		T const* operator ->() const { return object; }
+
+	private:
+		val_detail::epoch::record & reader;
+		T const * object;
+
+		// the record must have been entered
+		read_guard(val_detail::epoch::record & r, node const * n) : reader(r), object(&*n->value) {}
+	};
+
+	explicit atomic_val(val_type v) : current(new node(std::move(v))), retired(nullptr) {}
+
+	atomic_val(atomic_val const &) = delete;
+	atomic_val& operator =(atomic_val const &) = delete;
+
+	// requires that no thread is reading
+	~atomic_val() {
+		delete current.load(std::memory_order_acquire);
+		while (retired != nullptr) {
+			node * const next = retired->next;
+			delete retired;
+			retired = next;
+		}
+	}
+
+	read_guard load() const {
+		auto & r = val_detail::epoch::this_thread_record();
+		val_detail::epoch::enter(r);
+		return read_guard(r, current.load(std::memory_order_seq_cst));
+	}
+
+	// publish v, destroying the previous object once no reader can be accessing it
+	void store(val_type v) {
+		node * const replacement = new node(std::move(v));
+		std::lock_guard<std::mutex> lock(writer);
+		node * const previous = current.exchange(replacement, std::memory_order_seq_cst);
+		previous->epoch = val_detail::epoch::advance();
+		previous->next = retired;
+		retired = previous;
+		reclaim_retired();
+	}
+
+	// publish v and return the previous object, after waiting until no reader can be accessing it
+	val_type exchange(val_type v) {
+		assert(val_detail::epoch::this_thread_record().depth == 0 && "atomic_val::exchange would wait for a read guard of this thread");
+		node * const replacement = new node(std::move(v));
+		node * const previous = current.exchange(replacement, std::memory_order_seq_cst);
+		val_detail::epoch::synchronize(val_detail::epoch::advance());
+		val_type result(std::move(previous->value));
+		delete previous;
+		return result;
+	}
+
+	// destroy the replaced objects that no reader can be accessing
+	void reclaim() {
+		std::lock_guard<std::mutex> lock(writer);
+		reclaim_retired();
+	}
+
+private:
+	std::atomic<node *> current;
+	std::mutex writer;
+	node * retired; // replaced nodes, guarded by writer
+
+	void reclaim_retired() {
+		if (retired == nullptr) {
+			return;
+		}
+		uint64_t const oldest = val_detail::epoch::oldest_reader();
+		node ** link = &retired;
+		while (*link != nullptr) {
+			node * const n = *link;
+			if (n->epoch <= oldest) {
+				*link = n->next;
+				delete n;
+			} else {
+				link = &n->next;
+			}
+		}
+	}
+
+};
+
+#endif // INCLUDED_UTILITIES_VAL_ATOMIC_HPP
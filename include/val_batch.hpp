@@ -0,0 +1,215 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_BATCH_HPP
+#define INCLUDED_UTILITIES_VAL_BATCH_HPP
+
+#include "val.hpp"
+
+#include <new>
+
+namespace val_detail {
+
+	// the blocks of a val_batch live in its slab, which the val_batch frees itself
+	template <typename Threading>
+	void deallocate_batch_block(block<Threading> *) noexcept {}
+
+}
+
+// a fixed number of objects of type U, which is or inherits T, held by value in one allocation
+// the objects and the blocks for their ptrs share a single slab, are constructed in one loop, and are destroyed after a
+// single pass that checks for dangling ptrs; U is known statically, so no element operation goes through an op table
+// the objects do not move when the val_batch is moved, so ptrs to them remain valid
+template <typename T, typename U = T, typename Threading = val_multi_threaded>
+class val_batch {
+	static_assert(std::is_base_of<T, U>::value, "val_batch elements must be or inherit T");
+
+	using block = val_detail::block<Threading>;
+
+public:
+	typedef U value_type;
+	typedef U & reference;
+	typedef U const & const_reference;
+	typedef U * iterator;
+	typedef U const * const_iterator;
+	typedef size_t size_type;
+
+	val_batch() : slab(nullptr), objects(nullptr), blocks(nullptr), count(0) {}
+
+	// construct count objects, each from args
+	template <typename... ArgTs>
+	explicit val_batch(size_t count, ArgTs const &... args) : val_batch() {
+		allocate(count);
+		construct_each([&](void * placement, size_t) { val_detail::placement_construct<U>(placement, args...); });
+	}
+
+	val_batch(val_batch const & other) : val_batch() {
+		allocate(other.count);
+		construct_each([&](void * placement, size_t i) { val_detail::placement_copy<U>(other.objects[i], placement); });
+	}
+
+	val_batch(val_batch && other) noexcept : slab(other.slab), objects(other.objects), blocks(other.blocks), count(other.count) {
+		other.slab = nullptr;
+		other.objects = nullptr;
+		other.blocks = nullptr;
+		other.count = 0;
+	}
+
+	~val_batch() {
+		release();
+	}
+
+	val_batch& operator =(val_batch const & other) {
+		if (this != &other) {
+			*this = val_batch(other);
+		}
+		return *this;
+	}
+
+	val_batch& operator =(val_batch && other) noexcept {
+		if (this != &other) {
+			release();
+			slab = other.slab;
+			objects = other.objects;
+			blocks = other.blocks;
+			count = other.count;
+			other.slab = nullptr;
+			other.objects = nullptr;
+			other.blocks = nullptr;
+			other.count = 0;
+		}
+		return *this;
+	}
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	U& operator [](size_t index) { return objects[index]; }
+	U const& operator [](size_t index) const { return objects[index]; }
+
+	iterator begin() { return objects; }
+	iterator end() { return objects + count; }
+	const_iterator begin() const { return objects; }
+	const_iterator end() const { return objects + count; }
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+
+	// a ptr to the element at index, which uses the block that was allocated along with it
+	ptr<T, Threading> ptr_at(size_t index) {
+		return ptr<T, Threading>(&blocks[index], val_detail::compute_upcast_offset<T, U>());
+	}
+
+	ptr<T const, Threading> ptr_at(size_t index) const {
+		return ptr<T const, Threading>(&blocks[index], val_detail::compute_upcast_offset<T const, U>());
+	}
+
+private:
+	void * slab;
+	U * objects;
+	block * blocks;
+	size_t count;
+
+	static constexpr size_t slab_alignment = std::max(alignof(U), alignof(block));
+
+	static size_t blocks_offset(size_t count) {
+		return val_detail::align_up(count * sizeof(U), alignof(block));
+	}
+
+	void allocate(size_t n) {
+		if (n == 0) {
+			return;
+		}
+		size_t const bytes = blocks_offset(n) + n * sizeof(block);
+		if constexpr (slab_alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+			slab = ::operator new(bytes, std::align_val_t(slab_alignment));
+		} else {
+			slab = ::operator new(bytes);
+		}
+		objects = static_cast<U *>(slab);
+		blocks = reinterpret_cast<block *>(static_cast<int8_t *>(slab) + blocks_offset(n));
+		count = n;
+	}
+
+	static void deallocate(void * memory) noexcept {
+		if constexpr (slab_alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+			::operator delete(memory, std::align_val_t(slab_alignment));
+		} else {
+			::operator delete(memory);
+		}
+	}
+
+	// construct every object with f(placement, index), and its block
+	// if a constructor throws, the objects that were constructed are destroyed and the slab is freed
+	template <typename F>
+	void construct_each(F && f) {
+		size_t i = 0;
+		try {
+			for (; i < count; ++i) {
+				f(static_cast<void *>(objects + i), i);
+			}
+		} catch (...) {
+			destroy(i);
+			deallocate(slab);
+			slab = nullptr;
+			objects = nullptr;
+			blocks = nullptr;
+			count = 0;
+			throw;
+		}
+		for (i = 0; i < count; ++i) {
+			auto const b = new (static_cast<void *>(blocks + i)) block(static_cast<void *>(objects + i), &val_detail::op_table_of<U>, &val_detail::deallocate_batch_block<Threading>);
+			b->increment(); // the reference held by this val_batch
+		}
+	}
+
+	void destroy(size_t n) noexcept {
+		if constexpr (!std::is_trivially_destructible<U>::value) {
+			for (size_t i = 0; i < n; ++i) {
+				objects[i].~U();
+			}
+		}
+	}
+
+	void release() noexcept {
+		if (slab == nullptr) {
+			return;
+		}
+		// the blocks are in the slab, so ptrs cannot outlive a val_batch even when VAL_DANGLING lets them expire
+		if constexpr (val_detail::dangling != val_detail::dangling_policy::unchecked) {
+			intptr_t dangling = 0;
+			for (size_t i = 0; i < count; ++i) {
+				// acquire pairs with the release decrements of ptrs that were destroyed on other threads
+				dangling += blocks[i].count.load(std::memory_order_acquire) - 1;
+			}
+			if (dangling != 0) {
+				val_detail::abort_dangling("val_batch", dangling);
+			}
+		}
+		destroy(count);
+		if constexpr (!std::is_trivially_destructible<block>::value) {
+			for (size_t i = 0; i < count; ++i) {
+				blocks[i].~block();
+			}
+		}
+		deallocate(slab);
+		slab = nullptr;
+		objects = nullptr;
+		blocks = nullptr;
+		count = 0;
+	}
+
+};
+
+// construct count objects of type T, each from args, in a val_batch
+template <typename T, typename... ArgTs>
+val_batch<T> make_vals(size_t count, ArgTs const &... args) {
+	return val_batch<T>(count, args...);
+}
+
+// construct count objects of type U that inherits T, each from args, in a val_batch
+template <typename T, typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+val_batch<T, U> make_vals(size_t count, ArgTs const &... args) {
+	return val_batch<T, U>(count, args...);
+}
+
+#endif // INCLUDED_UTILITIES_VAL_BATCH_HPP
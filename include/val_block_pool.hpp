@@ -0,0 +1,175 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_BLOCK_POOL_HPP
+#define INCLUDED_UTILITIES_VAL_BLOCK_POOL_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <thread>
+
+// Define VAL_BLOCK_POOL to 1 to allocate the blocks that are not co-located with their object from per-thread free
+// lists rather than the global operator new. Those are the blocks created when a ptr is first taken from a val whose
+// object is in small storage, or was adopted or is over-aligned, and the blocks a val_cow uses to share such objects.
+// It must have the same value in every translation unit of a program.
+#ifndef VAL_BLOCK_POOL
+#	define VAL_BLOCK_POOL 0
+#endif
+
+namespace val_detail {
+
+	// fixed size slots, cached by each thread and exchanged with a shared list in batches, so that blocks churned by many
+	// threads rarely touch shared state; a slot that is freed on another thread joins the cache of that thread
+	// slot memory is never returned to the global operator new
+	namespace block_pool {
+
+		constexpr bool enabled = VAL_BLOCK_POOL != 0;
+
+		constexpr size_t slot_size = 4 * sizeof(void *);
+		constexpr size_t batch_size = 64;
+
+		struct free_slot {
+			free_slot * next;
+			free_slot * next_batch; // only used by the first slot of a batch in the shared list
+			size_t batch_count; // likewise
+		};
+
+		static_assert(sizeof(free_slot) <= slot_size, "a free slot must fit in a slot");
+
+		// the batches that threads have returned, and the chunks that slots are carved from
+		// trivially destructible, so it remains usable while other static and thread local objects are destroyed
+		struct shared_list {
+			std::atomic_flag lock = ATOMIC_FLAG_INIT;
+			free_slot * batches = nullptr;
+			void * chunks = nullptr; // each chunk starts with a pointer to the previous one
+		};
+
+		inline shared_list shared;
+
+		class shared_lock {
+		public:
+			shared_lock() {
+				while (shared.lock.test_and_set(std::memory_order_acquire)) {
+					std::this_thread::yield();
+				}
+			}
+
+			shared_lock(shared_lock const &) = delete;
+			shared_lock& operator =(shared_lock const &) = delete;
+
+			~shared_lock() {
+				shared.lock.clear(std::memory_order_release);
+			}
+		};
+
+		// the slots cached by one thread
+		struct cache {
+			free_slot * head = nullptr;
+			size_t count = 0;
+			bool exited = false; // the thread has flushed its cache during its exit
+		};
+
+		inline thread_local cache local;
+
+		// a batch of count slots from the shared list, or from a new chunk, which the caller must hold the lock for
+		inline free_slot * take_batch(size_t & count) {
+			if (shared.batches != nullptr) {
+				free_slot * const result = shared.batches;
+				shared.batches = result->next_batch;
+				count = result->batch_count;
+				return result;
+			}
+			auto const chunk = static_cast<unsigned char *>(::operator new((batch_size + 1) * slot_size));
+			*reinterpret_cast<void **>(chunk) = shared.chunks;
+			shared.chunks = chunk;
+			free_slot * result = nullptr;
+			for (size_t i = batch_size; i > 0; --i) {
+				auto const s = reinterpret_cast<free_slot *>(chunk + i * slot_size);
+				s->next = result;
+				result = s;
+			}
+			count = batch_size;
+			return result;
+		}
+
+		// give count slots starting at first to the shared list, which the caller must hold the lock for
+		inline void give_batch(free_slot * first, size_t count) {
+			first->next_batch = shared.batches;
+			first->batch_count = count;
+			shared.batches = first;
+		}
+
+		// returns the cache of a thread to the shared list when the thread exits
+		struct flusher {
+			~flusher() {
+				if (local.head != nullptr) {
+					shared_lock lock;
+					give_batch(local.head, local.count);
+				}
+				local.head = nullptr;
+				local.count = 0;
+				local.exited = true;
+			}
+		};
+
+		inline thread_local flusher local_flusher;
+
+		inline void register_flusher() {
+			(void)&local_flusher;
+		}
+
+		inline void * allocate() {
+			if (local.head == nullptr) {
+				shared_lock lock;
+				size_t count;
+				free_slot * const batch = take_batch(count);
+				if (local.exited) {
+					// the cache cannot be flushed again, so the rest of the batch goes back to the shared list
+					if (count > 1) {
+						give_batch(batch->next, count - 1);
+					}
+					return batch;
+				}
+				register_flusher();
+				local.head = batch;
+				local.count = count;
+			}
+			free_slot * const result = local.head;
+			local.head = result->next;
+			--local.count;
+			return result;
+		}
+
+		inline void deallocate(void * memory) noexcept {
+			auto const s = static_cast<free_slot *>(memory);
+			if (local.exited) {
+				shared_lock lock;
+				s->next = nullptr;
+				give_batch(s, 1);
+				return;
+			}
+			if (local.head == nullptr) {
+				register_flusher();
+			}
+			s->next = local.head;
+			local.head = s;
+			if (++local.count == 2 * batch_size) {
+				// keep one batch, and return the other
+				free_slot * last = local.head;
+				for (size_t i = 1; i < batch_size; ++i) {
+					last = last->next;
+				}
+				free_slot * const returned = last->next;
+				last->next = nullptr;
+				local.count = batch_size;
+				shared_lock lock;
+				give_batch(returned, batch_size);
+			}
+		}
+
+	}
+
+}
+
+#endif // INCLUDED_UTILITIES_VAL_BLOCK_POOL_HPP
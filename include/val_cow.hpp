@@ -0,0 +1,343 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_COW_HPP
+#define INCLUDED_UTILITIES_VAL_COW_HPP
+
+#include "val.hpp"
+
+// value semantic type erasure via base types, where copies of a heap object share it until one of them is modified
+// copying a val_cow whose object is on the heap only increments a reference count, and the first non-const access
+// through a copy that shares its object clones it; objects in small storage are cheap to copy, so they are never shared
+// a reference from non-const access remains valid when the val_cow is later copied, so a val_cow that gave one out
+// copies its object instead of sharing it, until the object is replaced
+// as with val_unique, no ptr can be taken from a val_cow
+// Threading selects whether copies that share an object may be used from different threads
+template<typename T, size_t SmallStorageSize = val_detail::small_storage_size<16, T>, typename Threading = val_multi_threaded>
+class val_cow : public val_detail::val_base<T, SmallStorageSize> {  // NOLINT(cppcoreguidelines-special-member-functions, hicpp-special-member-functions)
+	template <typename, size_t, typename>
+	friend class val_cow;
+
+	using base = val_detail::val_base<T, SmallStorageSize>;
+	using block = val_detail::block<Threading>;
+	using op_table = val_detail::op_table;
+
+	using base::object;
+	using base::upcast_offset;
+	using base::op_ptr;
+	using base::fits;
+	using base::small_address;
+	using base::is_small;
+	using base::get;
+	using base::instrument_placement;
+
+	// counts the val_cows that share a heap object, or nullptr when the object is in small storage
+	block * shared;
+	// set by non-const access, after which copies of this val_cow clone its object
+	bool unshareable;
+
+	val_cow() : shared(nullptr), unshareable(false) {}
+
+	val_cow(size_t offset, op_table const * op) : base(offset, op), shared(nullptr), unshareable(false) {}
+
+	// track a heap object that was not allocated along with a block
+	void share_separately(void * heapObject) {
+		try {
+			shared = val_detail::allocate_block<Threading>(heapObject, op_ptr);
+		} catch (...) {
+			val_detail::delete_(op_ptr, heapObject);
+			throw;
+		}
+		shared->increment();
+	}
+
+	// construct a U into this empty val_cow
+	template <typename U, typename... ArgTs>
+	void construct(ArgTs &&... args) {
+		op_table const * const op = &val_detail::op_table_of<U>;
+		if (fits(sizeof(U), alignof(U), std::is_nothrow_move_constructible<U>::value)) {
+			instrument_placement(small_address(), op);
+			object = val_detail::placement_construct<U>(small_address(), std::forward<ArgTs>(args)...);
+		} else {
+			instrument_placement(nullptr, op);
+			auto const s = val_detail::allocate_colocated<Threading>(op);
+			if (s.placement == nullptr) {
+				U * const heapObject = new U(std::forward<ArgTs>(args)...);
+				op_ptr = op;
+				share_separately(heapObject);
+				object = heapObject;
+			} else {
+				try {
+					object = val_detail::placement_construct<U>(s.placement, std::forward<ArgTs>(args)...);
+				} catch (...) {
+					s.block_ptr->deallocate(s.block_ptr);
+					throw;
+				}
+				shared = s.block_ptr;
+			}
+		}
+		upcast_offset = val_detail::compute_upcast_offset<T, U>();
+		op_ptr = op;
+	}
+
+	// clone the erased object of another val_cow into this empty val_cow, using the op_ptr of this val_cow
+	void clone_from(void const * source) {
+		val_detail::instrument<T>(val_instrumentation::event::clone, op_ptr, SmallStorageSize);
+		if (fits(op_ptr)) {
+			instrument_placement(small_address(), op_ptr);
+			object = val_detail::clone(op_ptr, source, small_address());
+			return;
+		}
+		instrument_placement(nullptr, op_ptr);
+		auto const s = val_detail::allocate_colocated<Threading>(op_ptr);
+		if (s.placement == nullptr) {
+			void * const heapObject = val_detail::clone(op_ptr, source, nullptr);
+			share_separately(heapObject);
+			object = heapObject;
+			return;
+		}
+		try {
+			object = val_detail::clone(op_ptr, source, s.placement);
+		} catch (...) {
+			s.block_ptr->deallocate(s.block_ptr);
+			throw;
+		}
+		shared = s.block_ptr;
+	}
+
+	// copy the object of other into this empty val_cow, sharing it if it is on the heap
+	template <typename U, size_t SmallStorageSizeU>
+	void copy_from(val_cow<U, SmallStorageSizeU, Threading> const & other) {
+		if (other.shared == nullptr || other.unshareable) {
+			if (other.object != nullptr) {
+				clone_from(other.object);
+			}
+			return;
+		}
+		other.shared->increment();
+		object = other.object;
+		shared = other.shared;
+	}
+
+	// take the erased object of other into this empty val_cow, leaving other empty
+	template <typename U, size_t SmallStorageSizeU>
+	void steal_from(val_cow<U, SmallStorageSizeU, Threading> & other) {
+		if (other.shared != nullptr || other.object == nullptr) {
+			object = other.object;
+			shared = other.shared;
+			// references to the object remain valid
+			unshareable = other.unshareable;
+		} else if (std::is_same<val_cow, val_cow<U, SmallStorageSizeU, Threading>>::value || fits(other.op_ptr)) {
+			object = val_detail::move(other.op_ptr, other.object, small_address());
+		} else {
+			// an object from small storage that does not fit in the small storage of this val_cow
+			auto const s = val_detail::allocate_colocated<Threading>(other.op_ptr);
+			object = val_detail::move(other.op_ptr, other.object, s.placement);
+			if (s.block_ptr == nullptr) {
+				share_separately(object);
+			} else {
+				shared = s.block_ptr;
+			}
+		}
+		other.object = nullptr;
+		other.shared = nullptr;
+		other.unshareable = false;
+	}
+
+	// destroy the erased object, or release this share of it, leaving this val_cow empty
+	void release() noexcept {
+		if (object == nullptr) {
+			return;
+		}
+		if (shared == nullptr) {
+			val_detail::destruct(op_ptr, object);
+		} else if (shared->count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			if (val_detail::is_colocated(shared)) {
+				val_detail::destruct(op_ptr, object);
+			} else {
+				val_detail::delete_(op_ptr, object);
+			}
+			shared->deallocate(shared);
+		}
+		object = nullptr;
+		shared = nullptr;
+		unshareable = false;
+	}
+
+	// give this val_cow its own copy of a shared object, before it is modified
+	void detach() {
+		if (is_shared()) {
+			val_cow copy(upcast_offset, op_ptr);
+			copy.clone_from(object);
+			*this = std::move(copy);
+		}
+	}
+
+	// give this val_cow its own copy of its object before handing out non-const access, and stop sharing it
+	void expose() {
+		detach();
+		unshareable = true;
+	}
+
+public:
+	// ReSharper disable CppNonExplicitConvertingConstructor
+	val_cow(T const & v) : shared(nullptr), unshareable(false) { //NOLINT(hicpp-explicit-conversions)
+		construct<T>(v);
+	}
+
+	val_cow(T && v) : shared(nullptr), unshareable(false) { //NOLINT(hicpp-explicit-conversions)
+		construct<T>(std::forward<T>(v));
+	}
+
+	// shares the object of other if it is on the heap
+	val_cow(val_cow const & other) : base(other.upcast_offset, other.op_ptr), shared(nullptr), unshareable(false) {
+		copy_from(other);
+	}
+
+	// the moved-from val_cow is left empty; it may only be assigned to or destroyed
+	val_cow(val_cow && other) noexcept : base(other.upcast_offset, other.op_ptr), shared(nullptr), unshareable(false) {
+		steal_from(other);
+	}
+
+	// construct a U that is or inherits T directly in the storage of this val_cow
+	template <typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	explicit val_cow(std::in_place_type_t<U>, ArgTs &&... args) : shared(nullptr), unshareable(false) {
+		construct<U>(std::forward<ArgTs>(args)...);
+	}
+
+	// construct from type U that inherits T
+	template <typename U, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+	val_cow(U const & v) : shared(nullptr), unshareable(false) { //NOLINT(hicpp-explicit-conversions)
+		construct<U>(v);
+	}
+
+	// construct from type U that inherits T
+	template <typename U, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+	val_cow(U && v) : shared(nullptr), unshareable(false) { //NOLINT(misc-forwarding-reference-overload, hicpp-explicit-conversions)
+		construct<U>(std::forward<U>(v));
+	}
+
+	// construct from val_cow<U> where U inherits T, sharing the object of other if it is on the heap
+	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	val_cow(val_cow<U, SmallStorageSizeU, Threading> const & other) : base(other.upcast_offset + val_detail::compute_upcast_offset<T, U>(), other.op_ptr), shared(nullptr), unshareable(false) { //NOLINT(hicpp-explicit-conversions)
+		copy_from(other);
+	}
+
+	// move from val_cow<U> where U inherits T
+	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<val_cow, val_cow<U, SmallStorageSizeU, Threading>>::value, int>::type = 0>
+	val_cow(val_cow<U, SmallStorageSizeU, Threading> && other) : base(other.upcast_offset + val_detail::compute_upcast_offset<T, U>(), other.op_ptr), shared(nullptr), unshareable(false) { //NOLINT(hicpp-explicit-conversions)
+		steal_from(other);
+	}
+
+	// ReSharper restore CppNonExplicitConvertingConstructor
+
+	~val_cow() noexcept {
+		release();
+	}
+
+	val_cow& operator =(val_cow const & other) {
+		if (this != &other) {
+			*this = val_cow(other);
+		}
+		return *this;
+	}
+
+	val_cow& operator =(val_cow && other) noexcept {
+		if (this != &other) {
+			release();
+			upcast_offset = other.upcast_offset;
+			op_ptr = other.op_ptr;
+			steal_from(other);
+		}
+		return *this;
+	}
+
+	// assign from val_cow<U> where U inherits T
+	template <typename U, size_t SmallStorageSizeU, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	val_cow& operator =(val_cow<U, SmallStorageSizeU, Threading> const & other) {
+		*this = val_cow(other);
+		return *this;
+	}
+
+	// destroy the current object and construct a U that is or inherits T in its place
+	// if the constructor of U throws, this val_cow is left empty
+	template <typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value, int>::type = 0>
+	U& emplace(ArgTs &&... args) {
+		release();
+		construct<U>(std::forward<ArgTs>(args)...);
+		return *static_cast<U *>(object);
+	}
+
+	// non-const access clones the object first if it is shared, and later copies of this val_cow clone it too
+	T& operator *() { expose(); return *get(); }
+	T* operator ->() { expose(); return get(); }
+	T const& operator *() const { return *get(); }
+	T const* operator ->() const { return get(); }
+
+	// visiting with non-const access clones the object first if it is shared, as operator * does
+	template <typename... Ds, typename F>
+	decltype(auto) visit(F && f) {
+		expose();
+		return base::template visit<Ds...>(std::forward<F>(f));
+	}
+
+	template <typename... Ds, typename F>
+	decltype(auto) visit(F && f) const {
+		return base::template visit<Ds...>(std::forward<F>(f));
+	}
+
+	// non-const access clones the object first if it is shared, as operator * does
+	template <typename U>
+	U * get_if() {
+		if (!base::template holds<U>()) {
+			return nullptr;
+		}
+		expose();
+		return base::template get_if<U>();
+	}
+
+	template <typename U>
+	U const * get_if() const {
+		return base::template get_if<U>();
+	}
+
+	// true when other val_cows refer to the same heap object
+	bool is_shared() const {
+		return shared != nullptr && shared->count.load(std::memory_order_acquire) != 1;
+	}
+
+	// the number of val_cows that refer to the object of this val_cow
+	size_t use_count() const {
+		return shared == nullptr ? 1 : static_cast<size_t>(shared->count.load(std::memory_order_relaxed));
+	}
+
+};
+
+// a val_cow without small storage only refers to its heap object and block
+template <typename T, typename Threading>
+struct val_is_trivially_relocatable<val_cow<T, 0, Threading>> : std::true_type {};
+
+template <typename T, typename... ArgTs>
+val_cow<T> make_val_cow(ArgTs &&... args) {
+	return val_cow<T>(std::in_place_type<T>, std::forward<ArgTs>(args)...);
+}
+
+// construct a U that inherits T directly in a val_cow<T>
+template <typename T, typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+val_cow<T> make_val_cow(ArgTs &&... args) {
+	return val_cow<T>(std::in_place_type<U>, std::forward<ArgTs>(args)...);
+}
+
+namespace std {
+
+	// hashes the object of a val_cow as its dynamic type, without detaching it
+	template <typename T, size_t SmallStorageSize, typename Threading>
+	struct hash<val_cow<T, SmallStorageSize, Threading>> {
+		size_t operator()(val_cow<T, SmallStorageSize, Threading> const & v) const {
+			return v.hash();
+		}
+	};
+
+}
+
+#endif // INCLUDED_UTILITIES_VAL_COW_HPP
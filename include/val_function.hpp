@@ -0,0 +1,72 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_FUNCTION_HPP
+#define INCLUDED_UTILITIES_VAL_FUNCTION_HPP
+
+#include "val_iface.hpp"
+
+#include <functional>
+
+namespace val_detail {
+
+	// the members that every val_function has, whatever its signature
+	template <typename Self>
+	struct function_members {
+		// false when the val_function is empty
+		explicit operator bool() const {
+			return !static_cast<Self const &>(*this).empty();
+		}
+	};
+
+	// the interface of a callable with the given signature
+	template <typename Signature>
+	struct function_interface;
+
+	template <typename R, typename... ArgTs>
+	struct function_interface<R(ArgTs...)> {
+		typedef val_iface_signatures<R(ArgTs...)> signatures;
+
+		template <typename T>
+		static constexpr auto functions = std::make_tuple([](T & t, ArgTs... args) -> R {
+			return static_cast<R>(std::invoke(t, std::forward<ArgTs>(args)...));
+		});
+
+		template <typename Self>
+		struct members : function_members<Self> {
+			R operator ()(ArgTs... args) {
+				return val_iface_call<0>(*this, std::forward<ArgTs>(args)...);
+			}
+		};
+	};
+
+	template <typename R, typename... ArgTs>
+	struct function_interface<R(ArgTs...) const> {
+		typedef val_iface_signatures<R(ArgTs...) const> signatures;
+
+		template <typename T>
+		static constexpr auto functions = std::make_tuple([](T const & t, ArgTs... args) -> R {
+			return static_cast<R>(std::invoke(t, std::forward<ArgTs>(args)...));
+		});
+
+		template <typename Self>
+		struct members : function_members<Self> {
+			R operator ()(ArgTs... args) const {
+				return val_iface_call<0>(*this, std::forward<ArgTs>(args)...);
+			}
+		};
+	};
+
+}
+
+// a move-only callable, like std::function, that may hold callables that cannot be copied
+// a callable of up to SmallStorageSize bytes that can be moved without throwing is held in small storage, so
+// constructing and moving the val_function does not allocate
+// as with std::move_only_function, the call operator is const only for a const signature, such as int(int) const, which
+// requires the callable to be invocable as const; a const call of a mutable callable would modify a const object
+// a val_function that is default constructed, constructed from nullptr or moved from is empty, which converts to false;
+// it may only be assigned to, tested or destroyed
+template <typename Signature, size_t SmallStorageSize = 16>
+using val_function = val_iface<val_detail::function_interface<Signature>, SmallStorageSize, false>;
+
+#endif // INCLUDED_UTILITIES_VAL_FUNCTION_HPP
@@ -0,0 +1,279 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_IFACE_HPP
+#define INCLUDED_UTILITIES_VAL_IFACE_HPP
+
+#include "val.hpp"
+
+#include <tuple>
+
+// the signatures of the operations of an interface, in the order of their indices
+// a const qualified signature, such as double() const, is an operation that does not modify the object
+template <typename... Signatures>
+struct val_iface_signatures {};
+
+// An interface for val_iface is a struct that provides
+//     signatures, a val_iface_signatures that lists its operations,
+//     functions<T>, a constexpr tuple with one function per operation, which takes the object and then the arguments, and
+//     members<Self>, the member functions of val_iface<Interface>, which call the operations with val_iface_call.
+// For example:
+//     struct shape_interface {
+//         typedef val_iface_signatures<double() const, void(double)> signatures;
+//
+//         template <typename T>
+//         static constexpr auto functions = std::make_tuple(
+//             [](T const & t) { return t.area(); },
+//             [](T & t, double factor) { t.scale(factor); });
+//
+//         template <typename Self>
+//         struct members {
+//             double area() const { return val_iface_call<0>(*this); }
+//             void scale(double factor) { val_iface_call<1>(*this, factor); }
+//         };
+//     };
+
+namespace val_detail {
+
+	// the erased function of one operation, which takes the object as void const * or void *
+	template <typename Signature>
+	struct iface_function;
+
+	template <typename R, typename... ArgTs>
+	struct iface_function<R(ArgTs...) const> {
+		typedef R (*type)(void const *, ArgTs...);
+
+		template <typename Interface, typename T, size_t Index>
+		static R call(void const * object, ArgTs... args) {
+			return std::get<Index>(Interface::template functions<T>)(*static_cast<T const *>(object), std::forward<ArgTs>(args)...);
+		}
+	};
+
+	template <typename R, typename... ArgTs>
+	struct iface_function<R(ArgTs...)> {
+		typedef R (*type)(void *, ArgTs...);
+
+		template <typename Interface, typename T, size_t Index>
+		static R call(void * object, ArgTs... args) {
+			return std::get<Index>(Interface::template functions<T>)(*static_cast<T *>(object), std::forward<ArgTs>(args)...);
+		}
+	};
+
+	// the operations of an interface on one type, following the operations that every erased type has
+	template <typename Signatures>
+	struct iface_table;
+
+	template <typename... Signatures>
+	struct iface_table<val_iface_signatures<Signatures...>> : op_table {
+		std::tuple<typename iface_function<Signatures>::type...> functions;
+	};
+
+	template <typename Interface, typename T, typename... Signatures, size_t... Indices>
+	constexpr iface_table<val_iface_signatures<Signatures...>> make_iface_table(val_iface_signatures<Signatures...>, std::index_sequence<Indices...>) {
+		return { op_table_of<T>, { &iface_function<Signatures>::template call<Interface, T, Indices>... } };
+	}
+
+	template <typename Signatures>
+	struct signature_count;
+
+	template <typename... Signatures>
+	struct signature_count<val_iface_signatures<Signatures...>> : std::integral_constant<size_t, sizeof...(Signatures)> {};
+
+	// one constant instance per interface and type
+	template <typename Interface, typename T>
+	inline constexpr iface_table<typename Interface::signatures> iface_table_of = make_iface_table<Interface, T>(typename Interface::signatures(), std::make_index_sequence<signature_count<typename Interface::signatures>::value>());
+
+}
+
+template <typename Interface, size_t SmallStorageSize, bool Copyable>
+class val_iface;
+
+template <typename T>
+struct val_is_iface : std::false_type {};
+
+template <typename Interface, size_t SmallStorageSize, bool Copyable>
+struct val_is_iface<val_iface<Interface, SmallStorageSize, Copyable>> : std::true_type {};
+
+// value semantic type erasure via an interface, for types that need not share a base or have virtual functions
+// each operation is called through a single constant table for the type of the object, which also holds the operations
+// that copy, move and destroy it, so the object itself needs no vptr; as with val_unique, no ptr can be taken from a
+// val_iface
+// when Copyable is false, the val_iface is move-only and may hold types that cannot be copied
+template <typename Interface, size_t SmallStorageSize = 16, bool Copyable = true>
+class val_iface : public Interface::template members<val_iface<Interface, SmallStorageSize, Copyable>> { // NOLINT(cppcoreguidelines-special-member-functions, hicpp-special-member-functions)
+	typedef val_detail::iface_table<typename Interface::signatures> table_type;
+
+	// the parameter of the copy constructor and copy assignment, which are implicitly deleted when they take no_copy_source
+	typedef typename std::conditional<Copyable, val_iface, val_detail::no_copy_source>::type copy_source;
+
+	static constexpr size_t small_storage_alignment = alignof(std::max_align_t);
+
+	alignas(small_storage_alignment) unsigned char small_storage[SmallStorageSize > 0 ? SmallStorageSize : 1];
+	void * object;
+	table_type const * table;
+
+	// only types that can be relocated without throwing are placed in small_storage, so that moving is noexcept
+	static constexpr bool fits(size_t dataSize, size_t dataAlignment, bool nothrowMovable) {
+		return dataSize <= SmallStorageSize && dataAlignment <= small_storage_alignment && nothrowMovable;
+	}
+
+	static bool fits(val_detail::op_table const * op) {
+		return fits(val_detail::size(op), val_detail::alignment(op), val_detail::nothrow_movable(op));
+	}
+
+	void * small_address() {
+		return static_cast<void *>(&small_storage);
+	}
+
+	bool is_small() const {
+		return object == static_cast<void const *>(&small_storage);
+	}
+
+	// construct a U into this empty val_iface
+	template <typename U, typename... ArgTs>
+	void construct(ArgTs &&... args) {
+		static_assert(!Copyable || std::is_copy_constructible<U>::value, "a copyable val_iface cannot hold a type that cannot be copy constructed, see the Copyable parameter");
+		if (fits(sizeof(U), alignof(U), std::is_nothrow_move_constructible<U>::value)) {
+			object = val_detail::placement_construct<U>(small_address(), std::forward<ArgTs>(args)...);
+		} else {
+			object = new U(std::forward<ArgTs>(args)...);
+		}
+		table = &val_detail::iface_table_of<Interface, U>;
+	}
+
+	// take the erased object of other into this empty val_iface, leaving other empty
+	void steal_from(val_iface & other) {
+		table = other.table;
+		if (other.object != nullptr && other.is_small()) {
+			object = val_detail::move(table, other.object, small_address());
+		} else {
+			object = other.object;
+		}
+		other.object = nullptr;
+	}
+
+	// destroy the erased object, leaving this val_iface empty
+	void release() noexcept {
+		if (object == nullptr) {
+			return;
+		}
+		if (is_small()) {
+			val_detail::destruct(table, object);
+		} else {
+			val_detail::delete_(table, object);
+		}
+		object = nullptr;
+	}
+
+public:
+	// construct an empty val_iface, which may only be assigned to, tested or destroyed
+	val_iface() noexcept : object(nullptr), table(nullptr) {} //NOLINT(hicpp-member-init)
+
+	val_iface(std::nullptr_t) noexcept : val_iface() {} //NOLINT(hicpp-explicit-conversions)
+
+	// construct from a value of any type that implements Interface
+	template <typename U, typename std::enable_if<!val_is_iface<typename std::decay<U>::type>::value && !std::is_null_pointer<typename std::decay<U>::type>::value, int>::type = 0>
+	val_iface(U && v) : object(nullptr), table(nullptr) { //NOLINT(misc-forwarding-reference-overload, hicpp-explicit-conversions, hicpp-member-init)
+		construct<typename std::decay<U>::type>(std::forward<U>(v));
+	}
+
+	// construct a U directly in the storage of this val_iface
+	template <typename U, typename... ArgTs>
+	explicit val_iface(std::in_place_type_t<U>, ArgTs &&... args) : object(nullptr), table(nullptr) { //NOLINT(hicpp-member-init)
+		construct<U>(std::forward<ArgTs>(args)...);
+	}
+
+	val_iface(copy_source const & other) : object(nullptr), table(other.table) { //NOLINT(hicpp-member-init)
+		if (other.object != nullptr) {
+			object = val_detail::clone(table, other.object, fits(table) ? small_address() : nullptr);
+		}
+	}
+
+	// the moved-from val_iface is left empty
+	val_iface(val_iface && other) noexcept : object(nullptr), table(nullptr) { //NOLINT(hicpp-member-init)
+		steal_from(other);
+	}
+
+	~val_iface() noexcept {
+		release();
+	}
+
+	val_iface& operator =(copy_source const & other) {
+		if (this != &other) {
+			*this = val_iface(other);
+		}
+		return *this;
+	}
+
+	val_iface& operator =(val_iface && other) noexcept {
+		if (this != &other) {
+			release();
+			steal_from(other);
+		}
+		return *this;
+	}
+
+	// destroy the current object and construct a U in its place
+	// if the constructor of U throws, this val_iface is left empty
+	template <typename U, typename... ArgTs>
+	U& emplace(ArgTs &&... args) {
+		release();
+		construct<U>(std::forward<ArgTs>(args)...);
+		return *static_cast<U *>(object);
+	}
+
+	// call the operation at Index, for the member functions of the interface
+	template <size_t Index, typename... ArgTs>
+	decltype(auto) call(ArgTs &&... args) const {
+		return std::get<Index>(table->functions)(static_cast<void const *>(object), std::forward<ArgTs>(args)...);
+	}
+
+	template <size_t Index, typename... ArgTs>
+	decltype(auto) call(ArgTs &&... args) {
+		return std::get<Index>(table->functions)(object, std::forward<ArgTs>(args)...);
+	}
+
+	// true when this val_iface was default constructed, constructed from nullptr or moved from
+	bool empty() const {
+		return object == nullptr;
+	}
+
+	// true when the erased object lives in small_storage rather than on the heap
+	bool uses_small_storage() const {
+		return is_small();
+	}
+
+	std::type_info const & type() const {
+		return val_detail::type(table);
+	}
+
+	// the object, or nullptr if it is not exactly a U
+	template <typename U>
+	U * get_if() {
+		return table == &val_detail::iface_table_of<Interface, U> ? static_cast<U *>(object) : nullptr;
+	}
+
+	template <typename U>
+	U const * get_if() const {
+		return table == &val_detail::iface_table_of<Interface, U> ? static_cast<U const *>(object) : nullptr;
+	}
+
+};
+
+// call the operation at Index of the val_iface that inherits members, from a member function of an interface
+template <size_t Index, template <typename> class Members, typename Self, typename... ArgTs>
+decltype(auto) val_iface_call(Members<Self> const & members, ArgTs &&... args) {
+	return static_cast<Self const &>(members).template call<Index>(std::forward<ArgTs>(args)...);
+}
+
+template <size_t Index, template <typename> class Members, typename Self, typename... ArgTs>
+decltype(auto) val_iface_call(Members<Self> & members, ArgTs &&... args) {
+	return static_cast<Self &>(members).template call<Index>(std::forward<ArgTs>(args)...);
+}
+
+template <typename Interface, typename T, typename... ArgTs>
+val_iface<Interface> make_val_iface(ArgTs &&... args) {
+	return val_iface<Interface>(std::in_place_type<T>, std::forward<ArgTs>(args)...);
+}
+
+#endif // INCLUDED_UTILITIES_VAL_IFACE_HPP
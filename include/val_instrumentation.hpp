@@ -0,0 +1,229 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_INSTRUMENTATION_HPP
+#define INCLUDED_UTILITIES_VAL_INSTRUMENTATION_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <typeinfo>
+
+// Define VAL_INSTRUMENTATION to 1 to count the storage decisions of val, val_unique and ptr.
+// It must have the same value in every translation unit of a program. When it is 0, nothing is recorded and the
+// instrumentation compiles away entirely.
+#ifndef VAL_INSTRUMENTATION
+#	define VAL_INSTRUMENTATION 0
+#endif
+
+// the number of distinct (T, U, SmallStorageSize) heap fallback sites that are tracked individually
+#ifndef VAL_INSTRUMENTATION_SITES
+#	define VAL_INSTRUMENTATION_SITES 256
+#endif
+
+namespace val_instrumentation {
+
+	constexpr bool enabled = VAL_INSTRUMENTATION != 0;
+
+	enum class event {
+		heap_fallback, // an object was placed on the heap because it does not fit in small storage
+		small_storage_hit, // an object was placed in small storage
+		clone, // an object was copy constructed through its op table
+		ptr_increment, // a ptr took a reference to a block
+		ptr_decrement, // a ptr released a reference to a block
+	};
+
+	constexpr size_t event_count = 5;
+
+	// what an event concerns; t is nullptr when T was incomplete at the point of instrumentation
+	struct event_info {
+		std::type_info const * t;
+		std::type_info const * u;
+		size_t size; // sizeof(U)
+		size_t alignment; // alignof(U)
+		bool nothrow_movable; // small storage only holds types that are nothrow move constructible
+		size_t small_storage_size; // the SmallStorageSize of the val, or 0 for a ptr
+		size_t small_storage_alignment; // the alignment of the small storage of the val, which a hint of T may raise
+	};
+
+	// called for every event, from the thread that caused it
+	typedef void(*hook_sig)(event e, event_info const & info);
+
+	// the heap fallbacks of one (T, U, SmallStorageSize) combination
+	struct fallback_site {
+		std::atomic<int> state{0}; // empty, being claimed, or ready
+		event_info info{};
+		std::atomic<uint64_t> count{0};
+	};
+
+	namespace detail {
+
+		enum site_state { empty_site, claiming_site, ready_site };
+
+		constexpr size_t site_capacity = VAL_INSTRUMENTATION_SITES;
+
+		inline std::atomic<uint64_t> counts[event_count];
+		inline std::atomic<uint64_t> dropped_fallbacks{0};
+		inline fallback_site sites[site_capacity];
+		inline std::atomic<hook_sig> hook{nullptr};
+
+		inline bool same_type(std::type_info const * a, std::type_info const * b) {
+			return a == b || (a != nullptr && b != nullptr && *a == *b);
+		}
+
+		inline bool same_site(event_info const & a, event_info const & b) {
+			return a.small_storage_size == b.small_storage_size && same_type(a.t, b.t) && same_type(a.u, b.u);
+		}
+
+		inline size_t site_hash(event_info const & info) {
+			size_t const t = info.t == nullptr ? 0 : info.t->hash_code();
+			size_t const u = info.u == nullptr ? 0 : info.u->hash_code();
+			return (t * 31 + u) * 31 + info.small_storage_size;
+		}
+
+		// an open addressed table, so that recording never locks or allocates
+		inline void record_fallback(event_info const & info) {
+			size_t const start = site_hash(info) % site_capacity;
+			for (size_t probe = 0; probe < site_capacity; ++probe) {
+				fallback_site & site = sites[(start + probe) % site_capacity];
+				int state = site.state.load(std::memory_order_acquire);
+				if (state == empty_site && site.state.compare_exchange_strong(state, claiming_site, std::memory_order_acq_rel)) {
+					site.info = info;
+					site.state.store(ready_site, std::memory_order_release);
+					state = ready_site;
+				}
+				while (state == claiming_site) {
+					state = site.state.load(std::memory_order_acquire);
+				}
+				if (same_site(site.info, info)) {
+					site.count.fetch_add(1, std::memory_order_relaxed);
+					return;
+				}
+			}
+			dropped_fallbacks.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		inline void record(event e, event_info const & info) {
+			counts[static_cast<size_t>(e)].fetch_add(1, std::memory_order_relaxed);
+			if (e == event::heap_fallback) {
+				record_fallback(info);
+			}
+			hook_sig const h = hook.load(std::memory_order_acquire);
+			if (h != nullptr) {
+				h(e, info);
+			}
+		}
+
+		template <typename Stream>
+		void dump_type(Stream & os, std::type_info const * t) {
+			if (t == nullptr) {
+				os << "(incomplete)";
+			} else {
+				os << t->name();
+			}
+		}
+
+	}
+
+	// install a hook that is called for every event, or nullptr to remove it
+	inline void set_hook(hook_sig h) {
+		detail::hook.store(h, std::memory_order_release);
+	}
+
+	// the number of times e occurred since program start or the last reset
+	inline uint64_t count(event e) {
+		return detail::counts[static_cast<size_t>(e)].load(std::memory_order_relaxed);
+	}
+
+	// heap fallbacks that were counted in total, but not per site, because the site table was full
+	inline uint64_t dropped_fallbacks() {
+		return detail::dropped_fallbacks.load(std::memory_order_relaxed);
+	}
+
+	// zero all counters; sites that were seen remain in the table with a count of zero
+	inline void reset() {
+		for (auto & c : detail::counts) {
+			c.store(0, std::memory_order_relaxed);
+		}
+		for (auto & site : detail::sites) {
+			site.count.store(0, std::memory_order_relaxed);
+		}
+		detail::dropped_fallbacks.store(0, std::memory_order_relaxed);
+	}
+
+	// call f(event_info const &, uint64_t count) for the heap fallbacks of each (T, U, SmallStorageSize)
+	template <typename F>
+	void for_each_fallback(F && f) {
+		for (auto const & site : detail::sites) {
+			if (site.state.load(std::memory_order_acquire) == detail::ready_site) {
+				uint64_t const c = site.count.load(std::memory_order_relaxed);
+				if (c != 0) {
+					f(site.info, c);
+				}
+			}
+		}
+	}
+
+	// the smallest SmallStorageSize that would hold U in small storage, or 0 if no size can
+	// small storage starts at its alignment, so a U that is aligned no more than it needs no padding; a more aligned U
+	// cannot use small storage of any size, unless val_storage_hint raises the alignment for T
+	inline size_t required_small_storage_size(event_info const & info) {
+		return info.nothrow_movable && info.alignment <= info.small_storage_alignment ? info.size : 0;
+	}
+
+	// write a histogram of the heap fallbacks of each val<T, SmallStorageSize>, with the number of fallbacks that each
+	// larger SmallStorageSize would have avoided
+	template <typename Stream>
+	Stream & dump(Stream & os) {
+		fallback_site const * ordered[detail::site_capacity];
+		size_t used = 0;
+		for (auto const & site : detail::sites) {
+			if (site.state.load(std::memory_order_acquire) == detail::ready_site && site.count.load(std::memory_order_relaxed) != 0) {
+				ordered[used++] = &site;
+			}
+		}
+		// group by val type, then by the storage needed, so that the avoided fallbacks accumulate
+		std::sort(ordered, ordered + used, [](fallback_site const * a, fallback_site const * b) {
+			if (!detail::same_type(a->info.t, b->info.t)) {
+				return a->info.t == nullptr || (b->info.t != nullptr && a->info.t->before(*b->info.t));
+			}
+			if (a->info.small_storage_size != b->info.small_storage_size) {
+				return a->info.small_storage_size < b->info.small_storage_size;
+			}
+			// sites that cannot use small storage wrap around to the end
+			return required_small_storage_size(a->info) - 1 < required_small_storage_size(b->info) - 1;
+		});
+		os << "val heap fallbacks: " << count(event::heap_fallback) << ", small storage hits: " << count(event::small_storage_hit)
+			<< ", clones: " << count(event::clone) << ", ptr increments: " << count(event::ptr_increment)
+			<< ", ptr decrements: " << count(event::ptr_decrement) << "\n";
+		for (size_t i = 0; i < used;) {
+			event_info const & group = ordered[i]->info;
+			os << "val<";
+			detail::dump_type(os, group.t);
+			os << ", " << group.small_storage_size << ">\n";
+			uint64_t avoided = 0;
+			for (; i < used && detail::same_type(ordered[i]->info.t, group.t) && ordered[i]->info.small_storage_size == group.small_storage_size; ++i) {
+				event_info const & info = ordered[i]->info;
+				uint64_t const c = ordered[i]->count.load(std::memory_order_relaxed);
+				os << "  ";
+				detail::dump_type(os, info.u);
+				os << " (size " << info.size << ", alignment " << info.alignment << "): " << c;
+				size_t const required = required_small_storage_size(info);
+				if (required == 0) {
+					os << ", cannot use small storage\n";
+				} else {
+					avoided += c;
+					os << ", SmallStorageSize " << required << " avoids " << avoided << "\n";
+				}
+			}
+		}
+		if (dropped_fallbacks() != 0) {
+			os << "fallbacks not attributed to a site: " << dropped_fallbacks() << "\n";
+		}
+		return os;
+	}
+
+}
+
+#endif // INCLUDED_UTILITIES_VAL_INSTRUMENTATION_HPP
@@ -0,0 +1,25 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_MOVE_ONLY_HPP
+#define INCLUDED_UTILITIES_VAL_MOVE_ONLY_HPP
+
+#include "val.hpp"
+
+// value semantic type erasure via base types, for objects that may not be copyable
+// a val_unique whose copying is deleted, so holding a type that cannot be copy constructed is never a runtime error
+template <typename T, size_t SmallStorageSize = val_detail::small_storage_size<16, T>>
+using val_move_only = val_unique<T, SmallStorageSize, false>;
+
+template <typename T, typename... ArgTs>
+val_move_only<T> make_val_move_only(ArgTs &&... args) {
+	return val_move_only<T>(std::in_place_type<T>, std::forward<ArgTs>(args)...);
+}
+
+// construct a U that inherits T directly in a val_move_only<T>
+template <typename T, typename U, typename... ArgTs, typename std::enable_if<std::is_base_of<T, U>::value && !std::is_same<T, U>::value, int>::type = 0>
+val_move_only<T> make_val_move_only(ArgTs &&... args) {
+	return val_move_only<T>(std::in_place_type<U>, std::forward<ArgTs>(args)...);
+}
+
+#endif // INCLUDED_UTILITIES_VAL_MOVE_ONLY_HPP
@@ -0,0 +1,230 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_PARALLEL_HPP
+#define INCLUDED_UTILITIES_VAL_PARALLEL_HPP
+
+#include "val.hpp"
+
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <thread>
+#include <vector>
+
+// An executor runs a number of tasks and waits for all of them to finish. It provides
+//     size_t concurrency() const, the number of tasks that it would like to run at once, and
+//     void operator()(size_t tasks, F const & f) const, which calls f(task) for each task in [0, tasks).
+// f never throws. Any executor with these members can be passed to the functions below, for example one that hands the
+// tasks to an existing thread pool.
+
+// runs each task but the first on a thread of its own, and the first on the calling thread
+// if a thread cannot be started, the tasks that were not started run on the calling thread
+class val_thread_executor {
+public:
+	explicit val_thread_executor(size_t threads = std::thread::hardware_concurrency()) : threads(threads == 0 ? 1 : threads) {}
+
+	size_t concurrency() const { return threads; }
+
+	template <typename F>
+	void operator()(size_t tasks, F const & f) const {
+		std::vector<std::thread> workers;
+		size_t started = 1;
+		try {
+			workers.reserve(tasks - 1);
+			for (; started < tasks; ++started) {
+				workers.emplace_back([&f, started] { f(started); });
+			}
+		} catch (...) { // NOLINT(bugprone-empty-catch)
+		}
+		f(0);
+		for (size_t task = started; task < tasks; ++task) {
+			f(task);
+		}
+		for (auto & worker : workers) {
+			worker.join();
+		}
+	}
+
+private:
+	size_t threads;
+};
+
+// runs every task on the calling thread, in order
+class val_serial_executor {
+public:
+	size_t concurrency() const { return 1; }
+
+	template <typename F>
+	void operator()(size_t tasks, F const & f) const {
+		for (size_t task = 0; task < tasks; ++task) {
+			f(task);
+		}
+	}
+};
+
+class val_clone_arenas;
+
+template <typename RandomIt, typename Val, typename Executor = val_thread_executor>
+void val_clone_range(RandomIt first, RandomIt last, Val * dest, val_clone_arenas & arenas, Executor const & executor = Executor());
+
+// the memory resources that val_clone_range allocates the heap objects of clones from, one for each task
+// each resource is sized to hold every object that its task clones, so a task makes a single allocation that no other
+// thread contends for; memory is only returned when the val_clone_arenas is destroyed, which must not happen before the
+// clones and any ptrs to them
+class val_clone_arenas {
+	template <typename RandomIt, typename Val, typename Executor>
+	friend void val_clone_range(RandomIt, RandomIt, Val *, val_clone_arenas &, Executor const &);
+
+public:
+	val_clone_arenas() = default;
+	val_clone_arenas(val_clone_arenas const &) = delete;
+	val_clone_arenas& operator =(val_clone_arenas const &) = delete;
+	val_clone_arenas(val_clone_arenas &&) = default;
+	val_clone_arenas& operator =(val_clone_arenas &&) = default;
+	~val_clone_arenas() = default;
+
+	// the number of arenas, one for each task of each clone that used this val_clone_arenas
+	size_t size() const { return arenas.size(); }
+
+private:
+	std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> arenas;
+};
+
+namespace val_detail {
+
+	// the fewest elements that are worth a task of their own
+	constexpr size_t parallel_grain = 256;
+
+	template <typename Executor>
+	size_t task_count(Executor const & executor, size_t count) {
+		return std::max<size_t>(1, std::min(executor.concurrency(), count / parallel_grain));
+	}
+
+	// the first element of a task, and one past its last element
+	inline size_t task_begin(size_t count, size_t tasks, size_t task) {
+		return count / tasks * task + std::min(task, count % tasks);
+	}
+
+	// construct elements [0, count) with construct(index, task), split into contiguous runs, one for each task
+	// prepare(task, begin, end) is called by each task before it constructs its run
+	// if any construction throws, every element that was constructed is destroyed with destroy(index), and the first
+	// exception is rethrown
+	template <typename Executor, typename Prepare, typename Construct, typename Destroy>
+	void parallel_construct(Executor const & executor, size_t count, size_t tasks, Prepare const & prepare, Construct const & construct, Destroy const & destroy) {
+		if (tasks == 1) {
+			size_t i = 0;
+			try {
+				prepare(0, 0, count);
+				for (; i < count; ++i) {
+					construct(i, 0);
+				}
+			} catch (...) {
+				while (i != 0) {
+					destroy(--i);
+				}
+				throw;
+			}
+			return;
+		}
+		std::vector<std::exception_ptr> failures(tasks);
+		executor(tasks, [&](size_t const task) noexcept {
+			size_t const begin = task_begin(count, tasks, task);
+			size_t const end = task_begin(count, tasks, task + 1);
+			size_t i = begin;
+			try {
+				prepare(task, begin, end);
+				for (; i < end; ++i) {
+					construct(i, task);
+				}
+			} catch (...) {
+				failures[task] = std::current_exception();
+				while (i != begin) {
+					destroy(--i);
+				}
+			}
+		});
+		std::exception_ptr failure;
+		for (auto const & f : failures) {
+			if (f != nullptr) {
+				failure = f;
+				break;
+			}
+		}
+		if (failure == nullptr) {
+			return;
+		}
+		executor(tasks, [&](size_t const task) noexcept {
+			if (failures[task] == nullptr) {
+				for (size_t i = task_begin(count, tasks, task), end = task_begin(count, tasks, task + 1); i < end; ++i) {
+					destroy(i);
+				}
+			}
+		});
+		std::rethrow_exception(failure);
+	}
+
+	// call f(index) for every element of [0, count), split into contiguous runs, one for each task
+	// f must not throw
+	template <typename Executor, typename F>
+	void parallel_for_each(Executor const & executor, size_t count, F const & f) {
+		size_t const tasks = task_count(executor, count);
+		if (tasks == 1) {
+			for (size_t i = 0; i < count; ++i) {
+				f(i);
+			}
+			return;
+		}
+		executor(tasks, [&](size_t const task) noexcept {
+			for (size_t i = task_begin(count, tasks, task), end = task_begin(count, tasks, task + 1); i < end; ++i) {
+				f(i);
+			}
+		});
+	}
+
+}
+
+// copy construct the vals of [first, last) into the uninitialized storage at dest, like std::uninitialized_copy, with
+// the elements split between the tasks of executor
+// if a copy throws, every copy that was constructed is destroyed and the exception is rethrown
+template <typename RandomIt, typename Val, typename Executor = val_thread_executor>
+void val_clone_range(RandomIt first, RandomIt last, Val * dest, Executor const & executor = Executor()) {
+	size_t const count = static_cast<size_t>(std::distance(first, last));
+	val_detail::parallel_construct(executor, count, val_detail::task_count(executor, count),
+		[](size_t, size_t, size_t) {},
+		[&](size_t const i, size_t) { new (static_cast<void *>(dest + i)) Val(first[i]); },
+		[&](size_t const i) { dest[i].~Val(); });
+}
+
+// as above, allocating the heap objects of the copies from arenas, which must outlive the copies and their ptrs
+// each task first sums the heap memory of its elements, then makes one allocation that holds all of their copies
+template <typename RandomIt, typename Val, typename Executor>
+void val_clone_range(RandomIt first, RandomIt last, Val * dest, val_clone_arenas & arenas, Executor const & executor) {
+	size_t const count = static_cast<size_t>(std::distance(first, last));
+	size_t const tasks = val_detail::task_count(executor, count);
+	size_t const base = arenas.arenas.size();
+	arenas.arenas.resize(base + tasks);
+	// each task creates its own arena, so that its memory is first touched by the thread that fills it
+	val_detail::parallel_construct(executor, count, tasks,
+		[&](size_t const task, size_t const begin, size_t const end) {
+			size_t bytes = 0;
+			for (size_t i = begin; i < end; ++i) {
+				bytes += first[i].copy_resource_bytes();
+			}
+			if (bytes != 0) {
+				arenas.arenas[base + task] = std::make_unique<std::pmr::monotonic_buffer_resource>(bytes);
+			}
+		},
+		[&](size_t const i, size_t const task) { new (static_cast<void *>(dest + i)) Val(std::allocator_arg, arenas.arenas[base + task].get(), first[i]); },
+		[&](size_t const i) { dest[i].~Val(); });
+}
+
+// destroy the vals of [first, last), with the elements split between the tasks of executor
+template <typename RandomIt, typename Executor = val_thread_executor>
+void val_destroy_range(RandomIt first, RandomIt last, Executor const & executor = Executor()) {
+	typedef typename std::iterator_traits<RandomIt>::value_type value_type;
+	val_detail::parallel_for_each(executor, static_cast<size_t>(std::distance(first, last)), [&](size_t const i) { first[i].~value_type(); });
+}
+
+#endif // INCLUDED_UTILITIES_VAL_PARALLEL_HPP
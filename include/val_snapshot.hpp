@@ -0,0 +1,351 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_SNAPSHOT_HPP
+#define INCLUDED_UTILITIES_VAL_SNAPSHOT_HPP
+
+#include "val_vector.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#	define VAL_SNAPSHOT_MMAP 1
+#else
+#	define VAL_SNAPSHOT_MMAP 0
+#endif
+
+// specialize for each type that is saved in snapshots, giving it an id that is stable across builds:
+//   template <> struct val_type_id<square> : std::integral_constant<uint64_t, 1> {};
+template <typename T>
+struct val_type_id {};
+
+namespace val_detail {
+
+	// A snapshot file is laid out as
+	//     a snapshot_header,
+	//     a snapshot_type for each type that occurs in the snapshot,
+	//     a snapshot_entry for each element, at entries_offset, and
+	//     the arena of the val_vector, at arena_offset.
+	// The entries have the layout of arena_entry, with the index of the type of the element in place of its op table,
+	// so that loading replaces the index in place.
+
+	constexpr char snapshot_magic[8] = { 'v', 'a', 'l', 's', 'n', 'a', 'p', '1' };
+
+	// the alignment of the arena within the file, which is at least the alignment of any element of a val_vector
+	constexpr uint64_t snapshot_arena_alignment = 64;
+
+	struct snapshot_header {
+		char magic[8];
+		uint64_t type_count;
+		uint64_t count;
+		uint64_t entries_offset;
+		uint64_t arena_offset;
+		uint64_t arena_size;
+	};
+
+	struct snapshot_type {
+		uint64_t id;
+		uint64_t size; // checked against the type that is registered with the same id
+		uint64_t alignment;
+	};
+
+	struct snapshot_entry {
+		uint64_t object_offset;
+		uint64_t value_offset;
+		uint64_t type_index;
+	};
+
+	// the types that a snapshot may hold, which must be trivially copyable, so that their bytes are the objects
+	template <typename... Types>
+	struct snapshot_registry {
+		static_assert((std::is_trivially_copyable<Types>::value && ...), "only trivially copyable types can be saved in snapshots");
+
+		static constexpr op_table const * ops[] = { &op_table_of<Types>... };
+		static constexpr uint64_t ids[] = { val_type_id<Types>::value... };
+
+		// the index of the type of op, or sizeof...(Types) if it is not registered
+		static size_t find(op_table const * op) {
+			return static_cast<size_t>(std::find(std::begin(ops), std::end(ops), op) - std::begin(ops));
+		}
+
+		static size_t find(uint64_t id) {
+			return static_cast<size_t>(std::find(std::begin(ids), std::end(ids), id) - std::begin(ids));
+		}
+	};
+
+	// the bytes of a snapshot file, mapped privately so that the entries can be fixed up without writing to the file
+	class mapped_file {
+	public:
+		explicit mapped_file(char const * path) : bytes(nullptr), length(0) {
+#if VAL_SNAPSHOT_MMAP
+			int const fd = ::open(path, O_RDONLY);
+			if (fd < 0) {
+				throw std::system_error(errno, std::generic_category(), path);
+			}
+			struct stat status {};
+			if (::fstat(fd, &status) != 0) {
+				int const error = errno;
+				::close(fd);
+				throw std::system_error(error, std::generic_category(), path);
+			}
+			length = static_cast<size_t>(status.st_size);
+			void * const mapped = length == 0 ? nullptr : ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			int const error = errno;
+			::close(fd);
+			if (mapped == MAP_FAILED) {
+				throw std::system_error(error, std::generic_category(), path);
+			}
+			bytes = static_cast<int8_t *>(mapped);
+#else
+			std::FILE * const file = std::fopen(path, "rb");
+			if (file == nullptr) {
+				throw std::system_error(errno, std::generic_category(), path);
+			}
+			std::fseek(file, 0, SEEK_END);
+			length = static_cast<size_t>(std::ftell(file));
+			std::fseek(file, 0, SEEK_SET);
+			bytes = static_cast<int8_t *>(::operator new(length, std::align_val_t(snapshot_arena_alignment)));
+			bool const complete = std::fread(bytes, 1, length, file) == length;
+			std::fclose(file);
+			if (!complete) {
+				release();
+				throw std::runtime_error("val_snapshot: could not read the snapshot file");
+			}
+#endif
+		}
+
+		mapped_file(mapped_file && other) noexcept : bytes(other.bytes), length(other.length) {
+			other.bytes = nullptr;
+			other.length = 0;
+		}
+
+		mapped_file(mapped_file const &) = delete;
+		mapped_file& operator =(mapped_file const &) = delete;
+		mapped_file& operator =(mapped_file &&) = delete;
+
+		~mapped_file() {
+			release();
+		}
+
+		int8_t * data() const { return bytes; }
+		size_t size() const { return length; }
+
+	private:
+		int8_t * bytes;
+		size_t length;
+
+		void release() noexcept {
+			if (bytes == nullptr) {
+				return;
+			}
+#if VAL_SNAPSHOT_MMAP
+			::munmap(bytes, length);
+#else
+			::operator delete(bytes, std::align_val_t(snapshot_arena_alignment));
+#endif
+			bytes = nullptr;
+		}
+	};
+
+	// the private state of val_vector that snapshots read and write
+	struct snapshot_access {
+		template <typename T>
+		static int8_t const * arena(val_vector<T> const & v) { return v.arena; }
+
+		template <typename T>
+		static std::vector<arena_entry> const & entries(val_vector<T> const & v) { return v.entries; }
+
+		// make v an exact copy of the trivially copyable elements described by entries and arena
+		template <typename T>
+		static void assign(val_vector<T> & v, arena_entry const * entries, size_t count, int8_t const * arena, size_t arenaSize) {
+			v.clear();
+			v.reserve(count, arenaSize);
+			if (arenaSize != 0) {
+				std::memcpy(v.arena, arena, arenaSize);
+			}
+			v.entries.assign(entries, entries + count);
+			v.used = arenaSize;
+		}
+	};
+
+	inline void write_snapshot_bytes(std::FILE * file, void const * data, size_t size) {
+		if (size != 0 && std::fwrite(data, 1, size, file) != size) {
+			std::fclose(file);
+			throw std::runtime_error("val_snapshot: could not write the snapshot file");
+		}
+	}
+
+}
+
+// the elements of a val_vector<T> loaded from a snapshot file, which are used in place in the mapped file
+// loading makes no allocation or construction per element, and writes to the arena or entries only change the mapping
+// of this process, not the file
+template <typename T>
+class val_snapshot {
+	using entry = val_detail::arena_entry;
+
+	template <typename U, typename... Types>
+	friend val_snapshot<U> load_val_snapshot(char const * path);
+
+public:
+	typedef T value_type;
+	typedef T & reference;
+	typedef T const & const_reference;
+	typedef size_t size_type;
+	typedef val_detail::arena_iterator<T, int8_t> iterator;
+	typedef val_detail::arena_iterator<T const, int8_t const> const_iterator;
+
+	val_snapshot(val_snapshot &&) noexcept = default;
+
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	size_t arena_size() const { return used; }
+
+	T& operator [](size_t index) { return *value(entries[index]); }
+	T const& operator [](size_t index) const { return *value(entries[index]); }
+
+	iterator begin() { return iterator(arena, entries); }
+	iterator end() { return iterator(arena, entries + count); }
+	const_iterator begin() const { return const_iterator(arena, entries); }
+	const_iterator end() const { return const_iterator(arena, entries + count); }
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+
+	// the std::type_info of the element at index
+	std::type_info const & type(size_t index) const {
+		return val_detail::type(entries[index].op_ptr);
+	}
+
+	// copy the elements into a val_vector, which can grow, with one allocation for the arena and one for the entries
+	val_vector<T> to_vector() const {
+		val_vector<T> result;
+		val_detail::snapshot_access::assign(result, entries, count, arena, used);
+		return result;
+	}
+
+private:
+	val_detail::mapped_file file;
+	entry * entries;
+	int8_t * arena;
+	size_t count;
+	size_t used;
+
+	val_snapshot(val_detail::mapped_file && f, entry * entries, int8_t * arena, size_t count, size_t used) : file(std::move(f)), entries(entries), arena(arena), count(count), used(used) {}
+
+	T * value(entry const & e) const {
+		return reinterpret_cast<T *>(arena + e.value_offset);
+	}
+};
+
+// write the elements of v to a snapshot file at path, replacing it
+// every element must be of one of Types, each of which is trivially copyable and has a val_type_id
+template <typename... Types, typename T>
+void save_val_snapshot(val_vector<T> const & v, char const * path) {
+	typedef val_detail::snapshot_registry<Types...> registry;
+	auto const & entries = val_detail::snapshot_access::entries(v);
+	// the types that occur, in the order they first occur, and the index of each registered type among them
+	std::vector<val_detail::snapshot_type> types;
+	std::vector<size_t> indices(sizeof...(Types), sizeof...(Types));
+	std::vector<val_detail::snapshot_entry> records;
+	records.reserve(entries.size());
+	for (auto const & e : entries) {
+		size_t const registered = registry::find(e.op_ptr);
+		if (registered == sizeof...(Types)) {
+			throw std::invalid_argument("val_snapshot: an element is not of a type registered for the snapshot");
+		}
+		if (indices[registered] == sizeof...(Types)) {
+			indices[registered] = types.size();
+			types.push_back(val_detail::snapshot_type{ registry::ids[registered], val_detail::size(e.op_ptr), val_detail::alignment(e.op_ptr) });
+		}
+		records.push_back(val_detail::snapshot_entry{ e.object_offset, e.value_offset, indices[registered] });
+	}
+	val_detail::snapshot_header header{};
+	std::memcpy(header.magic, val_detail::snapshot_magic, sizeof(header.magic));
+	header.type_count = types.size();
+	header.count = records.size();
+	header.entries_offset = sizeof(header) + types.size() * sizeof(val_detail::snapshot_type);
+	header.arena_offset = val_detail::align_up(header.entries_offset + records.size() * sizeof(val_detail::snapshot_entry), val_detail::snapshot_arena_alignment);
+	header.arena_size = v.arena_size();
+	std::FILE * const file = std::fopen(path, "wb");
+	if (file == nullptr) {
+		throw std::system_error(errno, std::generic_category(), path);
+	}
+	char const padding[val_detail::snapshot_arena_alignment] = {};
+	val_detail::write_snapshot_bytes(file, &header, sizeof(header));
+	val_detail::write_snapshot_bytes(file, types.data(), types.size() * sizeof(val_detail::snapshot_type));
+	val_detail::write_snapshot_bytes(file, records.data(), records.size() * sizeof(val_detail::snapshot_entry));
+	val_detail::write_snapshot_bytes(file, padding, header.arena_offset - header.entries_offset - records.size() * sizeof(val_detail::snapshot_entry));
+	val_detail::write_snapshot_bytes(file, val_detail::snapshot_access::arena(v), v.arena_size());
+	if (std::fclose(file) != 0) {
+		throw std::runtime_error("val_snapshot: could not write the snapshot file");
+	}
+}
+
+// map the snapshot file at path, whose elements must be of Types, as saved by save_val_snapshot
+// the type ids of the file are resolved to the op tables of Types once per type, then each entry is fixed up in place
+template <typename T, typename... Types>
+val_snapshot<T> load_val_snapshot(char const * path) {
+	static_assert(sizeof(val_detail::snapshot_entry) == sizeof(val_detail::arena_entry) && sizeof(size_t) == sizeof(uint64_t) && sizeof(void *) == sizeof(uint64_t), "snapshots are loaded in place, which requires 64 bit offsets and pointers");
+	static_assert((std::is_base_of<T, Types>::value && ...), "the types of a val_snapshot<T> must inherit T");
+	typedef val_detail::snapshot_registry<Types...> registry;
+	val_detail::mapped_file file(path);
+	auto const invalid = [] { return std::runtime_error("val_snapshot: the file is not a valid snapshot"); };
+	val_detail::snapshot_header header{};
+	if (file.size() < sizeof(header)) {
+		throw invalid();
+	}
+	std::memcpy(&header, file.data(), sizeof(header));
+	// each bound is checked by subtracting from one already known to lie within the file, so that none can overflow
+	if (std::memcmp(header.magic, val_detail::snapshot_magic, sizeof(header.magic)) != 0
+		|| header.arena_offset < sizeof(header) || header.arena_offset > file.size()
+		|| header.arena_size > file.size() - header.arena_offset
+		|| header.arena_offset % val_detail::snapshot_arena_alignment != 0
+		|| header.type_count > (header.arena_offset - sizeof(header)) / sizeof(val_detail::snapshot_type)
+		|| header.entries_offset != sizeof(header) + header.type_count * sizeof(val_detail::snapshot_type)
+		|| header.count > (header.arena_offset - header.entries_offset) / sizeof(val_detail::snapshot_entry)) {
+		throw invalid();
+	}
+	auto const types = reinterpret_cast<val_detail::snapshot_type const *>(file.data() + sizeof(header));
+	size_t const upcast_offsets[] = { val_detail::compute_upcast_offset<T, Types>()... };
+	std::vector<val_detail::op_table const *> ops(header.type_count);
+	std::vector<size_t> value_offsets(header.type_count);
+	for (size_t i = 0; i < header.type_count; ++i) {
+		size_t const registered = registry::find(types[i].id);
+		if (registered == sizeof...(Types)) {
+			throw std::invalid_argument("val_snapshot: the snapshot holds a type that is not registered");
+		}
+		ops[i] = registry::ops[registered];
+		value_offsets[i] = upcast_offsets[registered];
+		if (types[i].size != val_detail::size(ops[i]) || types[i].alignment != val_detail::alignment(ops[i])) {
+			throw std::invalid_argument("val_snapshot: the layout of a registered type differs from the snapshot");
+		}
+	}
+	auto const records = reinterpret_cast<val_detail::snapshot_entry *>(file.data() + header.entries_offset);
+	for (size_t i = 0; i < header.count; ++i) {
+		auto const & r = records[i];
+		if (r.type_index >= header.type_count) {
+			throw invalid();
+		}
+		// each object must lie within the arena, at the alignment of its type, with its T subobject where T is in it
+		val_detail::op_table const * const op = ops[r.type_index];
+		size_t const size = val_detail::size(op);
+		if (size > header.arena_size || r.object_offset > header.arena_size - size
+			|| r.object_offset % val_detail::alignment(op) != 0
+			|| r.value_offset != r.object_offset + value_offsets[r.type_index]) {
+			throw invalid();
+		}
+		// replace the type index, which is in the place of the op table pointer of arena_entry
+		std::memcpy(&records[i].type_index, &ops[r.type_index], sizeof(val_detail::op_table const *));
+	}
+	int8_t * const arena = file.data() + header.arena_offset;
+	return val_snapshot<T>(std::move(file), reinterpret_cast<val_detail::arena_entry *>(records), arena, header.count, header.arena_size);
+}
+
+#endif // INCLUDED_UTILITIES_VAL_SNAPSHOT_HPP
@@ -0,0 +1,369 @@
+// Copyright Brent Lewis 2020
+// Released under the BSD 3-clause license
+
+#ifndef INCLUDED_UTILITIES_VAL_VECTOR_HPP
+#define INCLUDED_UTILITIES_VAL_VECTOR_HPP
+
+#include "val.hpp"
+#include "val_parallel.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+template <typename T>
+class val_vector;
+
+namespace val_detail {
+
+	struct snapshot_access;
+
+	// the location and type of one element of a val_vector
+	struct arena_entry {
+		size_t object_offset; // offset of the object in the arena
+		size_t value_offset; // offset of the T subobject in the arena
+		op_table const * op_ptr;
+	};
+
+	template <typename T, typename Byte>
+	class arena_iterator {
+		template <typename, typename>
+		friend class arena_iterator;
+
+	public:
+		typedef std::random_access_iterator_tag iterator_category;
+		typedef T value_type;
+		typedef ptrdiff_t difference_type;
+		typedef T * pointer;
+		typedef T & reference;
+
+		arena_iterator() : arena(nullptr), entry(nullptr) {}
+
+		arena_iterator(Byte * arena, arena_entry const * entry) : arena(arena), entry(entry) {}
+
+		// iterator to const_iterator
+		template <typename U, typename ByteU, typename std::enable_if<std::is_convertible<U *, T *>::value, int>::type = 0>
+		arena_iterator(arena_iterator<U, ByteU> const & other) : arena(other.arena), entry(other.entry) {} //NOLINT(hicpp-explicit-conversions)
+
+		reference operator *() const { return *operator ->(); }
+		pointer operator ->() const { return reinterpret_cast<pointer>(arena + entry->value_offset); }
+		reference operator [](difference_type n) const { return *(*this + n); }
+
+		arena_iterator& operator ++() { ++entry; return *this; }
+		arena_iterator operator ++(int) { auto result = *this; ++entry; return result; }
+		arena_iterator& operator --() { --entry; return *this; }
+		arena_iterator operator --(int) { auto result = *this; --entry; return result; }
+		arena_iterator& operator +=(difference_type n) { entry += n; return *this; }
+		arena_iterator& operator -=(difference_type n) { entry -= n; return *this; }
+		arena_iterator operator +(difference_type n) const { return arena_iterator(arena, entry + n); }
+		arena_iterator operator -(difference_type n) const { return arena_iterator(arena, entry - n); }
+		friend arena_iterator operator +(difference_type n, arena_iterator const & i) { return i + n; }
+
+		template <typename U, typename ByteU>
+		difference_type operator -(arena_iterator<U, ByteU> const & other) const { return entry - other.entry; }
+
+		template <typename U, typename ByteU>
+		bool operator ==(arena_iterator<U, ByteU> const & other) const { return entry == other.entry; }
+		template <typename U, typename ByteU>
+		bool operator !=(arena_iterator<U, ByteU> const & other) const { return entry != other.entry; }
+		template <typename U, typename ByteU>
+		bool operator <(arena_iterator<U, ByteU> const & other) const { return entry < other.entry; }
+		template <typename U, typename ByteU>
+		bool operator >(arena_iterator<U, ByteU> const & other) const { return entry > other.entry; }
+		template <typename U, typename ByteU>
+		bool operator <=(arena_iterator<U, ByteU> const & other) const { return entry <= other.entry; }
+		template <typename U, typename ByteU>
+		bool operator >=(arena_iterator<U, ByteU> const & other) const { return entry >= other.entry; }
+
+	private:
+		Byte * arena;
+		arena_entry const * entry;
+	};
+
+}
+
+// a sequence of objects of types that inherit T, stored contiguously in a single byte arena
+// elements are laid out in insertion order, so iteration walks memory linearly
+// element types must be nothrow move constructible, so that growing the arena cannot fail part way through
+// while every element is trivially relocatable (see val_is_trivially_relocatable), growth and erasure copy the arena as bytes
+template <typename T>
+class val_vector {
+	friend struct val_detail::snapshot_access;
+
+	using entry = val_detail::arena_entry;
+	using op_table = val_detail::op_table;
+
+public:
+	typedef T value_type;
+	typedef T & reference;
+	typedef T const & const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef val_detail::arena_iterator<T, int8_t> iterator;
+	typedef val_detail::arena_iterator<T const, int8_t const> const_iterator;
+
+	val_vector() : arena(nullptr), used(0), capacity(0), non_trivial(0) {}
+
+	val_vector(val_vector const & other) : val_vector(other, val_serial_executor()) {}
+
+	// copy, cloning the elements in parallel on the tasks of executor, see val_parallel.hpp
+	// the layout of other is preserved, so the arena is allocated once and each task clones its elements into their offsets
+	template <typename Executor>
+	val_vector(val_vector const & other, Executor const & executor) : arena(nullptr), used(0), capacity(0), non_trivial(0) {
+		if (other.used == 0) {
+			entries = other.entries;
+			return;
+		}
+		int8_t * const cloned = allocate(other.used);
+		try {
+			entries = other.entries;
+			val_detail::parallel_construct(executor, entries.size(), val_detail::task_count(executor, entries.size()),
+				[](size_t, size_t, size_t) {},
+				[&](size_t const i, size_t) { val_detail::clone(entries[i].op_ptr, other.arena + entries[i].object_offset, cloned + entries[i].object_offset); },
+				[&](size_t const i) { val_detail::destruct(entries[i].op_ptr, cloned + entries[i].object_offset); });
+		} catch (...) {
+			entries.clear();
+			deallocate(cloned);
+			throw;
+		}
+		arena = cloned;
+		used = other.used;
+		capacity = other.used;
+		non_trivial = other.non_trivial;
+	}
+
+	val_vector(val_vector && other) noexcept : arena(other.arena), used(other.used), capacity(other.capacity), entries(std::move(other.entries)), non_trivial(other.non_trivial) {
+		other.arena = nullptr;
+		other.used = 0;
+		other.capacity = 0;
+		other.entries.clear();
+		other.non_trivial = 0;
+	}
+
+	~val_vector() {
+		clear();
+		deallocate(arena);
+	}
+
+	val_vector& operator =(val_vector const & other) {
+		if (this != &other) {
+			*this = val_vector(other);
+		}
+		return *this;
+	}
+
+	val_vector& operator =(val_vector && other) noexcept {
+		if (this != &other) {
+			clear();
+			deallocate(arena);
+			arena = other.arena;
+			used = other.used;
+			capacity = other.capacity;
+			entries = std::move(other.entries);
+			non_trivial = other.non_trivial;
+			other.arena = nullptr;
+			other.used = 0;
+			other.capacity = 0;
+			other.entries.clear();
+			other.non_trivial = 0;
+		}
+		return *this;
+	}
+
+	// construct a U that is or inherits T at the end of the arena
+	template <typename U, typename... ArgTs>
+	U& emplace_back(ArgTs &&... args) {
+		static_assert(std::is_base_of<T, U>::value, "val_vector elements must inherit T");
+		static_assert(std::is_nothrow_move_constructible<U>::value, "val_vector elements must be nothrow move constructible");
+		static_assert(alignof(U) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__, "val_vector does not support over-aligned types");
+		size_t const offset = val_detail::align_up(used, alignof(U));
+		// reserve the entry first, so that recording the constructed element cannot throw
+		if (entries.size() == entries.capacity()) {
+			entries.reserve(std::max<size_t>(8, entries.size() * 2));
+		}
+		U * result;
+		if (offset + sizeof(U) > capacity) {
+			// construct before relocating, in case args refer to an element of this val_vector
+			size_t const grown = std::max(offset + sizeof(U), capacity * 2);
+			int8_t * const fresh = allocate(grown);
+			try {
+				result = val_detail::placement_construct<U>(fresh + offset, std::forward<ArgTs>(args)...);
+			} catch (...) {
+				deallocate(fresh);
+				throw;
+			}
+			relocate(fresh);
+			capacity = grown;
+		} else {
+			result = val_detail::placement_construct<U>(arena + offset, std::forward<ArgTs>(args)...);
+		}
+		entries.push_back(entry{ offset, offset + val_detail::compute_upcast_offset<T, U>(), &val_detail::op_table_of<U> });
+		used = offset + sizeof(U);
+		non_trivial += val_is_trivially_relocatable<U>::value ? 0 : 1;
+		return *result;
+	}
+
+	template <typename U, typename std::enable_if<std::is_base_of<T, typename std::decay<U>::type>::value, int>::type = 0>
+	void push_back(U && v) {
+		emplace_back<typename std::decay<U>::type>(std::forward<U>(v));
+	}
+
+	void pop_back() {
+		auto const & e = entries.back();
+		val_detail::destruct(e.op_ptr, arena + e.object_offset);
+		used = e.object_offset;
+		non_trivial -= val_detail::trivially_relocatable(e.op_ptr) ? 0 : 1;
+		entries.pop_back();
+	}
+
+	void clear() noexcept {
+		destroy(arena, entries.data(), entries.size());
+		entries.clear();
+		used = 0;
+		non_trivial = 0;
+	}
+
+	iterator erase(const_iterator position) {
+		return erase(position, position + 1);
+	}
+
+	// destroy [first, last) and move the following elements down to close the gap
+	// an element that is not trivially relocatable stays in place if its new location would overlap its old one
+	iterator erase(const_iterator first, const_iterator last) {
+		size_t const begin = static_cast<size_t>(first - cbegin());
+		size_t const end = static_cast<size_t>(last - cbegin());
+		size_t const count = end - begin;
+		if (count == 0) {
+			return iterator(arena, entries.data() + begin);
+		}
+		destroy(arena, entries.data() + begin, count);
+		for (size_t i = begin; i < end; ++i) {
+			non_trivial -= val_detail::trivially_relocatable(entries[i].op_ptr) ? 0 : 1;
+		}
+		size_t const cursor = begin == 0 ? 0 : entries[begin - 1].object_offset + val_detail::size(entries[begin - 1].op_ptr);
+		size_t const tail = end < entries.size() ? entries[end].object_offset : used;
+		if (std::all_of(entries.begin() + end, entries.end(), [](entry const & e) { return val_detail::trivially_relocatable(e.op_ptr); })) {
+			// shifting by a multiple of the largest element alignment keeps every element aligned
+			size_t const shift = (tail - cursor) / __STDCPP_DEFAULT_NEW_ALIGNMENT__ * __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+			std::memmove(arena + tail - shift, arena + tail, used - tail);
+			for (size_t i = end; i < entries.size(); ++i) {
+				entries[i].object_offset -= shift;
+				entries[i].value_offset -= shift;
+			}
+			used = end < entries.size() ? used - shift : cursor;
+		} else {
+			used = compact(end, cursor);
+		}
+		entries.erase(entries.begin() + static_cast<difference_type>(begin), entries.begin() + static_cast<difference_type>(end));
+		return iterator(arena, entries.data() + begin);
+	}
+
+	// reserve space for count entries and bytes of arena
+	void reserve(size_t count, size_t bytes) {
+		entries.reserve(count);
+		if (bytes > capacity) {
+			int8_t * const fresh = allocate(bytes);
+			relocate(fresh);
+			capacity = bytes;
+		}
+	}
+
+	size_t size() const { return entries.size(); }
+	bool empty() const { return entries.empty(); }
+
+	// bytes of arena in use, including alignment padding
+	size_t arena_size() const { return used; }
+	size_t arena_capacity() const { return capacity; }
+
+	T& operator [](size_t index) { return *value(entries[index]); }
+	T const& operator [](size_t index) const { return *value(entries[index]); }
+
+	T& front() { return *value(entries.front()); }
+	T const& front() const { return *value(entries.front()); }
+	T& back() { return *value(entries.back()); }
+	T const& back() const { return *value(entries.back()); }
+
+	iterator begin() { return iterator(arena, entries.data()); }
+	iterator end() { return iterator(arena, entries.data() + entries.size()); }
+	const_iterator begin() const { return const_iterator(arena, entries.data()); }
+	const_iterator end() const { return const_iterator(arena, entries.data() + entries.size()); }
+	const_iterator cbegin() const { return begin(); }
+	const_iterator cend() const { return end(); }
+
+	// the std::type_info of the element at index
+	std::type_info const & type(size_t index) const {
+		return *entries[index].op_ptr->type;
+	}
+
+private:
+	int8_t * arena;
+	size_t used;
+	size_t capacity;
+	std::vector<entry> entries;
+	size_t non_trivial; // the number of elements that are not trivially relocatable
+
+	T * value(entry const & e) const {
+		return reinterpret_cast<T *>(arena + e.value_offset);
+	}
+
+	static int8_t * allocate(size_t bytes) {
+		return static_cast<int8_t *>(::operator new(bytes));
+	}
+
+	static void deallocate(int8_t * memory) noexcept {
+		::operator delete(static_cast<void *>(memory));
+	}
+
+	static void destroy(int8_t * memory, entry const * first, size_t count) noexcept {
+		for (size_t i = 0; i < count; ++i) {
+			val_detail::destruct(first[i].op_ptr, memory + first[i].object_offset);
+		}
+	}
+
+	// move every element to the same offset in fresh, and adopt fresh as the arena
+	void relocate(int8_t * fresh) noexcept {
+		if (non_trivial == 0) {
+			if (used != 0) {
+				std::memcpy(fresh, arena, used);
+			}
+		} else {
+			for (auto const & e : entries) {
+				relocate_element(e.op_ptr, arena + e.object_offset, fresh + e.object_offset);
+			}
+		}
+		deallocate(arena);
+		arena = fresh;
+	}
+
+	static void relocate_element(op_table const * op, int8_t * from, int8_t * to) noexcept {
+		if (val_detail::trivially_relocatable(op)) {
+			std::memmove(to, from, val_detail::size(op));
+		} else {
+			val_detail::move(op, from, to);
+		}
+	}
+
+	// move the elements from index first onwards down to the lowest aligned offsets at or after cursor, returning the end of the last element
+	size_t compact(size_t first, size_t cursor) noexcept {
+		for (size_t i = first; i < entries.size(); ++i) {
+			entry & e = entries[i];
+			size_t const bytes = val_detail::size(e.op_ptr);
+			size_t offset = val_detail::align_up(cursor, val_detail::alignment(e.op_ptr));
+			if (offset != e.object_offset) {
+				if (val_detail::trivially_relocatable(e.op_ptr) || offset + bytes <= e.object_offset) {
+					relocate_element(e.op_ptr, arena + e.object_offset, arena + offset);
+				} else {
+					offset = e.object_offset;
+				}
+			}
+			e.value_offset = e.value_offset - e.object_offset + offset;
+			e.object_offset = offset;
+			cursor = offset + bytes;
+		}
+		return cursor;
+	}
+
+};
+
+#endif // INCLUDED_UTILITIES_VAL_VECTOR_HPP
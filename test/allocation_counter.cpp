@@ -0,0 +1,45 @@
+#include "allocation_counter.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+	std::atomic<size_t> count(0);
+}
+
+namespace test_support {
+
+	size_t allocation_count() {
+		return count.load(std::memory_order_relaxed);
+	}
+
+}
+
+void * operator new(size_t size) {
+	count.fetch_add(1, std::memory_order_relaxed);
+	if (void * const result = std::malloc(size == 0 ? 1 : size)) {
+		return result;
+	}
+	throw std::bad_alloc();
+}
+
+void * operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void * p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void * p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void * p, size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void * p, size_t) noexcept {
+	std::free(p);
+}
@@ -0,0 +1,26 @@
+#ifndef INCLUDED_TEST_ALLOCATION_COUNTER_HPP
+#define INCLUDED_TEST_ALLOCATION_COUNTER_HPP
+
+#include <cstddef>
+
+namespace test_support {
+
+	// number of calls to the global operator new since program start
+	size_t allocation_count();
+
+	// counts the global allocations performed during its lifetime
+	class allocation_scope {
+	public:
+		allocation_scope() : start(allocation_count()) {}
+
+		size_t allocations() const {
+			return allocation_count() - start;
+		}
+
+	private:
+		size_t start;
+	};
+
+}
+
+#endif // INCLUDED_TEST_ALLOCATION_COUNTER_HPP
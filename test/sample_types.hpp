@@ -0,0 +1,38 @@
+#ifndef INCLUDED_TEST_SAMPLE_TYPES_HPP
+#define INCLUDED_TEST_SAMPLE_TYPES_HPP
+
+#include <atomic>
+#include <cstdint>
+
+namespace test_support {
+
+	// an abstract base for the objects held by the vals under test
+	struct sample {
+		virtual ~sample() = default;
+		virtual int32_t value() const = 0;
+	};
+
+	struct small_sample : sample {
+		explicit small_sample(int32_t const v) : v(v) {}
+		int32_t value() const override { return v; }
+		int32_t v;
+	};
+
+	// too large for the small storage the tests use
+	struct large_sample : sample {
+		explicit large_sample(int32_t const v) { values[0] = v; }
+		int32_t value() const override { return values[0]; }
+		int32_t values[64] = {};
+	};
+
+	// counts live instances, from any thread
+	struct counted_sample : large_sample {
+		static inline std::atomic<int32_t> live{ 0 };
+		explicit counted_sample(int32_t const v) : large_sample(v) { ++live; }
+		counted_sample(counted_sample const & other) : large_sample(other) { ++live; }
+		~counted_sample() override { --live; }
+	};
+
+}
+
+#endif // INCLUDED_TEST_SAMPLE_TYPES_HPP
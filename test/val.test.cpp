@@ -1,9 +1,16 @@
 #include "../include/val.hpp"
+#include "allocation_counter.hpp"
 
 #include <cassert>
 
 #include "gtest/gtest.h"
+#include <map>
 #include <optional>
+#include <string>
+#include <tuple>
+#include <unordered_set>
+#include <variant>
+#include <vector>
 
 struct base1 {
 	base1() : value1(1) {}
@@ -41,6 +48,11 @@ static_assert(val_detail::small_storage_size<0, derived2> == sizeof(derived2));
 struct undefined;
 static_assert(val_detail::small_storage_size<0, undefined> == 0);
 
+static_assert(val_detail::op_table_of<derived2>.size == sizeof(derived2));
+static_assert(val_detail::op_table_of<derived2>.alignment == alignof(derived2));
+static_assert(val_detail::op_table_of<derived2>.nothrow_movable);
+static_assert(val_detail::op_table_of<derived2>.type == &typeid(derived2));
+
 TEST(ValTest, val_constructor_test1) {
 	auto x = make_val<derived2>();
 	EXPECT_EQ(1, x->value1);
@@ -136,13 +148,952 @@ TEST(ValTest, val_collection_test_1) {
 }
 
 TEST(ValTest, val_move_test_1) {
-	// Move is not supported. This should compile to a copy construction
 	auto x = make_val<base1>();
 	val<base1> y(std::move(x));
+	EXPECT_EQ(1, y->value1);
 }
 
 TEST(ValTest, val_move_test_2) {
-	// Move is not supported. This should compile to copy construction
 	std::vector<val<base1>> x = { make_val<base1>() };
 	std::vector<val<base1>> y(std::move(x));
+	EXPECT_EQ(1, y[0]->value1);
+}
+
+struct alignas(32) overaligned1 : base1 {
+	int32_t padding[7];
+};
+
+TEST(ValTest, val_small_storage_test_1) {
+	test_support::allocation_scope scope;
+	{
+		auto x = make_val<derived2>(5, 6, 7, 8);
+		EXPECT_TRUE(x.uses_small_storage());
+		EXPECT_EQ(5, x->value1);
+	}
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValTest, val_small_storage_test_2) {
+	auto const x = make_val<derived2>(5, 6, 7, 8);
+	test_support::allocation_scope scope;
+	{
+		val<derived2> y(x);
+		val<derived1, sizeof(derived2)> z(x);
+		EXPECT_TRUE(y.uses_small_storage());
+		EXPECT_TRUE(z.uses_small_storage());
+		EXPECT_EQ(6, y->value2);
+		EXPECT_EQ(8, static_cast<derived2 const &>(*z).value4);
+	}
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValTest, val_small_storage_test_3) {
+	// derived2 does not fit in the small storage of val<base1>
+	auto const x = make_val<derived2>(5, 6, 7, 8);
+	test_support::allocation_scope scope;
+	{
+		val<base1> y(x);
+		EXPECT_FALSE(y.uses_small_storage());
+		EXPECT_EQ(5, y->value1);
+	}
+	EXPECT_EQ(1u, scope.allocations());
+}
+
+TEST(ValTest, val_small_storage_alignment_test) {
+	static_assert(alignof(overaligned1) > val<base1, 64>::small_storage_alignment, "test requires an over-aligned type");
+	val<base1, 64> x((overaligned1()));
+	EXPECT_FALSE(x.uses_small_storage());
+	EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&*x) % alignof(overaligned1));
+	val<base1, 64> y((derived2()));
+	EXPECT_TRUE(y.uses_small_storage());
+	EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&*y) % alignof(std::max_align_t));
+}
+
+struct hinted1 {
+	virtual ~hinted1() = default;
+	virtual int32_t value() const = 0;
+};
+
+struct hinted_small1 : hinted1 {
+	int32_t value() const override { return 1; }
+};
+
+struct alignas(32) hinted_large1 : hinted1 {
+	int32_t value() const override { return values[0]; }
+	int32_t values[12] = { 2 };
+};
+
+template <>
+struct val_storage_hint<hinted1> : val_derived_types<hinted1, hinted_small1, hinted_large1> {
+	static constexpr bool require_small_storage = true;
+};
+
+static_assert(val<hinted1>::small_storage_size == sizeof(hinted_large1));
+static_assert(val<hinted1>::small_storage_alignment == alignof(hinted_large1));
+static_assert(val_unique<hinted1>::small_storage_size == sizeof(hinted_large1));
+
+TEST(ValTest, val_storage_hint_test) {
+	test_support::allocation_scope scope;
+	{
+		val<hinted1> x((hinted_small1()));
+		val<hinted1> y((hinted_large1()));
+		EXPECT_TRUE(x.uses_small_storage());
+		EXPECT_TRUE(y.uses_small_storage());
+		EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&*y) % alignof(hinted_large1));
+		EXPECT_EQ(2, y->value());
+		x = y;
+		EXPECT_EQ(2, x->value());
+	}
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(PtrTest, ptr_small_storage_test) {
+	val<derived2> x((derived2(5, 6, 7, 8)));
+	EXPECT_TRUE(x.uses_small_storage());
+	ptr<base2> y(x);
+	EXPECT_EQ(6, y->value2);
+	EXPECT_EQ(&*x, &*ptr<derived2>(x));
+}
+
+static_assert(sizeof(ptr<base1>) == 2 * sizeof(void *), "ptr must be two words");
+static_assert(sizeof(ptr<base1, val_single_threaded>) == 2 * sizeof(void *), "ptr must be two words");
+static_assert(std::is_nothrow_move_constructible<val<base1>>::value, "val must be nothrow move constructible");
+static_assert(std::is_nothrow_move_assignable<val<base1>>::value, "val must be nothrow move assignable");
+
+TEST(ValTest, val_move_test_3) {
+	// heap objects are stolen
+	val<base1> x((derived2(5, 6, 7, 8)));
+	EXPECT_FALSE(x.uses_small_storage());
+	base1 const * const address = &*x;
+	test_support::allocation_scope scope;
+	val<base1> y(std::move(x));
+	EXPECT_EQ(address, &*y);
+	EXPECT_EQ(5, y->value1);
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValTest, val_move_test_4) {
+	// objects in small storage are relocated
+	auto x = make_val<derived2>(5, 6, 7, 8);
+	test_support::allocation_scope scope;
+	val<derived2> y(std::move(x));
+	EXPECT_TRUE(y.uses_small_storage());
+	EXPECT_EQ(8, y->value4);
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValTest, val_move_test_5) {
+	// converting move
+	test_support::allocation_scope scope;
+	val<derived1, sizeof(derived2)> x(make_val<derived2>(5, 6, 7, 8));
+	EXPECT_TRUE(x.uses_small_storage());
+	EXPECT_EQ(7, x->value3);
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValTest, val_move_test_6) {
+	// moving between small storage sizes steals a heap object rather than copying it
+	val<base1, 8> x((derived2(5, 6, 7, 8)));
+	EXPECT_FALSE(x.uses_small_storage());
+	base1 const * const address = &*x;
+	test_support::allocation_scope scope;
+	val<base1, 4> y(std::move(x));
+	EXPECT_EQ(address, &*y);
+	x = val<base1, 8>(std::move(y));
+	EXPECT_EQ(address, &*x);
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+static_assert(val_is_trivially_relocatable_v<val<base1, 0>>);
+static_assert(val_is_trivially_relocatable_v<val_unique<base1, 0>>);
+static_assert(!val_is_trivially_relocatable_v<val<base1, 8>>, "small storage is referred to by the val itself");
+static_assert(val_detail::op_table_of<derived2>.trivially_relocatable);
+
+TEST(ValTest, val_relocate_test_1) {
+	typedef val<base1, 0> heap_val;
+	alignas(heap_val) unsigned char from[2 * sizeof(heap_val)];
+	alignas(heap_val) unsigned char to[2 * sizeof(heap_val)];
+	auto const first = reinterpret_cast<heap_val *>(from);
+	new (first) heap_val(derived2(5, 6, 7, 8));
+	new (first + 1) heap_val(derived1(9, 10, 11));
+	base1 const * const address = &*first[1];
+	auto const dest = reinterpret_cast<heap_val *>(to);
+	EXPECT_EQ(dest + 2, val_relocate(first, first + 2, dest));
+	EXPECT_EQ(5, dest[0]->value1);
+	EXPECT_EQ(address, &*dest[1]);
+	dest[0].~heap_val();
+	dest[1].~heap_val();
+}
+
+TEST(ValTest, val_relocate_test_2) {
+	// small objects are moved, heap objects are copied as bytes along with their block
+	typedef val<base1, sizeof(base1)> mixed_val;
+	alignas(mixed_val) unsigned char from[2 * sizeof(mixed_val)];
+	alignas(mixed_val) unsigned char to[2 * sizeof(mixed_val)];
+	auto const first = reinterpret_cast<mixed_val *>(from);
+	new (first) mixed_val(base1(1));
+	new (first + 1) mixed_val(derived2(5, 6, 7, 8));
+	EXPECT_TRUE(first[0].uses_small_storage());
+	EXPECT_FALSE(first[1].uses_small_storage());
+	auto const dest = reinterpret_cast<mixed_val *>(to);
+	{
+		ptr<base1> p(first[0]);
+		ptr<base1> q(first[1]);
+		test_support::allocation_scope scope;
+		val_relocate(first, first + 2, dest);
+		EXPECT_EQ(0u, scope.allocations());
+		EXPECT_TRUE(dest[0].uses_small_storage());
+		EXPECT_EQ(1, p->value1);
+		EXPECT_EQ(&*dest[0], &*p);
+		EXPECT_EQ(&*dest[1], &*q);
+		EXPECT_EQ(8, static_cast<derived2 const &>(*dest[1]).value4);
+	}
+	dest[0].~mixed_val();
+	dest[1].~mixed_val();
+}
+
+TEST(ValTest, val_relocate_in_place_test) {
+	typedef val<base1, sizeof(base1)> mixed_val;
+	alignas(mixed_val) unsigned char storage[2 * sizeof(mixed_val)];
+	auto const first = reinterpret_cast<mixed_val *>(storage);
+	new (first) mixed_val(base1(1));
+	new (first + 1) mixed_val(derived2(5, 6, 7, 8));
+	{
+		ptr<base1> p(first[0]);
+		EXPECT_EQ(first + 2, val_relocate(first, first + 2, first));
+		EXPECT_EQ(&*first[0], &*p);
+		EXPECT_EQ(1, p->value1);
+		EXPECT_EQ(8, static_cast<derived2 const &>(*first[1]).value4);
+	}
+	first[0].~mixed_val();
+	first[1].~mixed_val();
+}
+
+TEST(ValTest, val_move_assignment_test) {
+	auto x = make_val<derived2>(5, 6, 7, 8);
+	auto y = make_val<derived2>();
+	y = std::move(x);
+	EXPECT_EQ(5, y->value1);
+	EXPECT_EQ(8, y->value4);
+}
+
+TEST(ValTest, val_move_collection_test) {
+	std::vector<val<base1>> v;
+	for (int32_t i = 0; i < 16; ++i) {
+		v.push_back(val<base1>(derived2(i, 0, 0, 0)));
+	}
+	std::vector<base1 const *> addresses;
+	for (auto const & x : v) {
+		addresses.push_back(&*x);
+	}
+	test_support::allocation_scope scope;
+	v.reserve(v.capacity() * 2);
+	std::reverse(v.begin(), v.end());
+	EXPECT_EQ(1u, scope.allocations());
+	for (int32_t i = 0; i < 16; ++i) {
+		EXPECT_EQ(15 - i, v[i]->value1);
+		EXPECT_EQ(addresses[15 - i], &*v[i]);
+	}
+}
+
+TEST(PtrTest, ptr_follows_move_test) {
+	auto x = make_val<derived2>(5, 6, 7, 8);
+	{
+		ptr<base2> p(x);
+		val<derived2> y(std::move(x));
+		EXPECT_EQ(&*y, &static_cast<derived2 &>(*p));
+		EXPECT_EQ(6, p->value2);
+		x = std::move(y);
+		EXPECT_EQ(6, p->value2);
+	}
+}
+
+template <typename T, size_t SmallStorageSize = val_detail::small_storage_size<16, T>>
+using local_val = val<T, SmallStorageSize, val_single_threaded>;
+
+template <typename T>
+using local_ptr = ptr<T, val_single_threaded>;
+
+static_assert(!std::is_constructible<ptr<base1>, local_val<base1> const &>::value, "ptrs must not mix threading policies");
+static_assert(std::is_nothrow_move_constructible<local_val<base1>>::value, "val must be nothrow move constructible");
+
+TEST(PtrTest, ptr_single_threaded_test_1) {
+	local_val<derived2> x((derived2(5, 6, 7, 8)));
+	{
+		local_ptr<base2> p(x);
+		local_ptr<base2> q(p);
+		local_val<derived2> y(std::move(x));
+		EXPECT_EQ(6, q->value2);
+		x = std::move(y);
+		EXPECT_EQ(&*x, &static_cast<derived2 &>(*p));
+	}
+}
+
+TEST(PtrTest, ptr_single_threaded_test_2) {
+	// heap objects share their allocation with a co-located block
+	test_support::allocation_scope scope;
+	{
+		local_val<base1, 4> x((derived2(5, 6, 7, 8)));
+		local_ptr<base1> p(x);
+		local_val<base1, 4> y(x);
+		EXPECT_FALSE(y.uses_small_storage());
+		EXPECT_EQ(5, p->value1);
+		EXPECT_EQ(5, y->value1);
+	}
+	EXPECT_EQ(2u, scope.allocations());
+}
+
+TEST(ValTest, val_assignment_test_2) {
+	auto const x = make_val<derived2>(5, 6, 7, 8);
+	val<base1> y = make_val<base1>();
+	y = x;
+	EXPECT_EQ(5, y->value1);
+	EXPECT_EQ(8, static_cast<derived2 const &>(*y).value4);
+}
+
+TEST(ValTest, val_assignment_test_3) {
+	// same dynamic type reuses the existing storage, including heap storage
+	val<base1> x((derived2(5, 6, 7, 8)));
+	val<base1> y((derived2()));
+	base1 const * const address = &*y;
+	test_support::allocation_scope scope;
+	for (int i = 0; i < 100; ++i) {
+		y = x;
+	}
+	EXPECT_EQ(0u, scope.allocations());
+	EXPECT_EQ(address, &*y);
+	EXPECT_EQ(8, static_cast<derived2 const &>(*y).value4);
+}
+
+TEST(ValTest, val_assignment_test_4) {
+	auto const x = make_val<derived2>(5, 6, 7, 8);
+	val<derived1, sizeof(derived2)> y((derived1()));
+	derived1 const * const address = &*y;
+	y = x;
+	EXPECT_TRUE(y.uses_small_storage());
+	EXPECT_EQ(address, &*y);
+	EXPECT_EQ(8, static_cast<derived2 const &>(*y).value4);
+	test_support::allocation_scope scope;
+	y = x;
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValTest, val_assignment_test_5) {
+	auto x = make_val<derived2>(5, 6, 7, 8);
+	val<base2> y((base2()));
+	y = std::move(x);
+	EXPECT_EQ(6, y->value2);
+}
+
+namespace {
+
+	struct immutable {
+		int32_t const x;
+	};
+
+	// std::vector declares copy assignment for any element, so holder appears copy assignable, but the assignment only
+	// compiles for elements that can be assigned
+	struct holder {
+		std::vector<immutable> items;
+	};
+
+	struct keyed_holder {
+		std::map<int32_t, int32_t> items;
+	};
+
+	struct shape {
+		virtual ~shape() = default;
+		virtual int32_t area() const = 0;
+	};
+
+	struct square : shape {
+		explicit square(int32_t const side) : side(side) {}
+		int32_t area() const override { return side * side; }
+		int32_t side;
+		int32_t padding[16] = {};
+	};
+
+}
+
+template <>
+struct val_assign_in_place<keyed_holder> : std::true_type {};
+
+template <>
+struct val_assign_in_place<square> : std::true_type {};
+
+static_assert(std::is_copy_assignable<holder>::value && !val_assign_in_place_v<holder>);
+static_assert(!val_assign_in_place_v<concrete1>);
+
+TEST(ValTest, val_assignment_unassignable_elements_test) {
+	val<holder> x((holder{ { immutable{ 1 }, immutable{ 2 } } }));
+	val<holder> y((holder{}));
+	// copied into a temporary and moved
+	y = x;
+	EXPECT_EQ(2u, y->items.size());
+	EXPECT_EQ(2, y->items[1].x);
+	val<keyed_holder> z((keyed_holder{ { { 1, 2 } } }));
+	val<keyed_holder> w((keyed_holder{}));
+	keyed_holder const * const address = &*w;
+	w = z;
+	EXPECT_EQ(address, &*w);
+	EXPECT_EQ(2, w->items.at(1));
+}
+
+TEST(ValTest, val_assignment_polymorphic_test) {
+	// a polymorphic type flagged by val_assign_in_place reuses the existing heap storage
+	val<shape> x((square(3)));
+	val<shape> y((square(4)));
+	EXPECT_FALSE(y.uses_small_storage());
+	shape const * const address = &*y;
+	test_support::allocation_scope scope;
+	y = x;
+	EXPECT_EQ(0u, scope.allocations());
+	EXPECT_EQ(address, &*y);
+	EXPECT_EQ(9, y->area());
+}
+
+TEST(PtrTest, ptr_survives_assignment_test) {
+	auto const x = make_val<derived2>(5, 6, 7, 8);
+	auto y = make_val<derived2>();
+	ptr<base1> p(y);
+	y = x;
+	EXPECT_EQ(5, p->value1);
+}
+
+TEST(ValTest, val_colocated_test_1) {
+	// the block and the object share one allocation
+	test_support::allocation_scope scope;
+	{
+		val<base1> x((derived2(5, 6, 7, 8)));
+		EXPECT_FALSE(x.uses_small_storage());
+		ptr<base1> p(x);
+		val<base1> y(x);
+		EXPECT_EQ(5, p->value1);
+		EXPECT_EQ(5, y->value1);
+	}
+	EXPECT_EQ(2u, scope.allocations());
+}
+
+TEST(ValTest, val_colocated_test_2) {
+	// moving a heap val keeps its co-located block
+	test_support::allocation_scope scope;
+	{
+		val<base1> x((derived2(5, 6, 7, 8)));
+		val<base1> y(std::move(x));
+		ptr<base1> p(y);
+		EXPECT_EQ(5, p->value1);
+		x = std::move(y);
+		EXPECT_EQ(5, p->value1);
+	}
+	EXPECT_EQ(1u, scope.allocations());
+}
+
+TEST(ValTest, val_colocated_test_3) {
+	// a small object relocated to the heap by a converting move
+	auto x = make_val<derived2>(5, 6, 7, 8);
+	test_support::allocation_scope scope;
+	val<base1> y(std::move(x));
+	EXPECT_FALSE(y.uses_small_storage());
+	EXPECT_EQ(1u, scope.allocations());
+	ptr<base1> p(y);
+	EXPECT_EQ(5, p->value1);
+	EXPECT_EQ(1u, scope.allocations());
+}
+
+TEST(ValTest, val_adopt_test) {
+	val<base1> x(new base1(5));
+	val<base1> y(x);
+	{
+		ptr<base1> p(x);
+		EXPECT_EQ(5, p->value1);
+		y = std::move(x);
+		EXPECT_EQ(5, p->value1);
+	}
+	EXPECT_EQ(5, y->value1);
+}
+
+TEST(ValTest, val_adopt_nullptr_test) {
+	EXPECT_THROW(val<base1>(static_cast<base1 *>(nullptr)), std::invalid_argument);
+	EXPECT_THROW(val_unique<base1>(static_cast<base1 *>(nullptr)), std::invalid_argument);
+}
+
+static_assert(sizeof(val_unique<base1, 8>) < sizeof(val<base1, 8>), "val_unique must not pay for the block");
+static_assert(sizeof(val_unique<base1, 16>) <= sizeof(val<base1, 16>), "val_unique must not pay for the block");
+
+TEST(ValUniqueTest, val_unique_constructor_test) {
+	test_support::allocation_scope scope;
+	{
+		auto x = make_val_unique<derived2>(5, 6, 7, 8);
+		EXPECT_TRUE(x.uses_small_storage());
+		val_unique<derived2> y(x);
+		val_unique<derived2> z(std::move(x));
+		EXPECT_EQ(5, y->value1);
+		EXPECT_EQ(8, z->value4);
+	}
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValUniqueTest, val_unique_upcast_test) {
+	auto const x = make_val_unique<derived2>(5, 6, 7, 8);
+	test_support::allocation_scope scope;
+	{
+		val_unique<base2> y(x);
+		EXPECT_FALSE(y.uses_small_storage());
+		EXPECT_EQ(6, y->value2);
+		val_unique<base2> z(std::move(y));
+		EXPECT_EQ(6, z->value2);
+	}
+	EXPECT_EQ(1u, scope.allocations());
+}
+
+TEST(ValUniqueTest, val_unique_assignment_test) {
+	val_unique<base1, sizeof(derived2)> x((derived2(5, 6, 7, 8)));
+	val_unique<base1, sizeof(derived2)> y((derived2()));
+	test_support::allocation_scope scope;
+	y = x;
+	EXPECT_EQ(0u, scope.allocations());
+	EXPECT_EQ(8, static_cast<derived2 const &>(*y).value4);
+	y = val_unique<base1, sizeof(derived2)>(base1(9));
+	EXPECT_EQ(9, y->value1);
+}
+
+TEST(ValUniqueTest, val_unique_abstract_test) {
+	std::vector<val_unique<abstract1>> v;
+	v.emplace_back(concrete1());
+	v.emplace_back(concrete1());
+	v.reserve(16);
+	EXPECT_EQ(1337, (*v[1])());
+}
+
+namespace {
+	// counts copies and moves to verify in place construction
+	struct counted : base1 {
+		static int copies;
+		static int moves;
+		explicit counted(int32_t const value1) : base1(value1) {}
+		counted(counted const & other) : base1(other) { ++copies; }
+		counted(counted && other) noexcept : base1(other) { ++moves; }
+		counted& operator =(counted const &) = default;
+	};
+	int counted::copies = 0;
+	int counted::moves = 0;
+}
+
+TEST(ValTest, val_in_place_test_1) {
+	counted::copies = 0;
+	counted::moves = 0;
+	auto x = make_val<counted>(5);
+	val<base1> y(std::in_place_type<counted>, 6);
+	auto z = make_val<base1, counted>(7);
+	auto w = make_val_unique<base1, counted>(8);
+	EXPECT_EQ(0, counted::copies);
+	EXPECT_EQ(0, counted::moves);
+	EXPECT_EQ(5, x->value1);
+	EXPECT_EQ(6, y->value1);
+	EXPECT_EQ(7, z->value1);
+	EXPECT_EQ(8, w->value1);
+}
+
+TEST(ValTest, val_in_place_test_2) {
+	test_support::allocation_scope scope;
+	auto x = make_val<base1, derived2>(5, 6, 7, 8);
+	EXPECT_FALSE(x.uses_small_storage());
+	EXPECT_EQ(1u, scope.allocations());
+	EXPECT_EQ(8, static_cast<derived2 &>(*x).value4);
+}
+
+TEST(ValTest, val_emplace_test) {
+	counted::copies = 0;
+	counted::moves = 0;
+	val<base1, sizeof(derived2)> x((base1()));
+	auto & d = x.emplace<derived2>(5, 6, 7, 8);
+	EXPECT_EQ(&d, &*x);
+	EXPECT_TRUE(x.uses_small_storage());
+	EXPECT_EQ(6, d.value2);
+	x.emplace<counted>(9);
+	EXPECT_EQ(9, x->value1);
+	val_unique<base1> y((base1()));
+	y.emplace<counted>(10);
+	EXPECT_EQ(10, y->value1);
+	EXPECT_EQ(0, counted::copies);
+	EXPECT_EQ(0, counted::moves);
+}
+
+namespace {
+	// forwards to new_delete_resource, counting outstanding allocations
+	class counting_resource : public std::pmr::memory_resource {
+	public:
+		int allocations = 0;
+		int outstanding = 0;
+
+	private:
+		void * do_allocate(size_t bytes, size_t alignment) override {
+			++allocations;
+			++outstanding;
+			return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		}
+
+		void do_deallocate(void * p, size_t bytes, size_t alignment) override {
+			--outstanding;
+			std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+		}
+
+		bool do_is_equal(std::pmr::memory_resource const & other) const noexcept override {
+			return this == &other;
+		}
+	};
+}
+
+TEST(ValTest, val_memory_resource_test_1) {
+	counting_resource resource;
+	{
+		auto x = allocate_val<base1, derived2>(&resource, 5, 6, 7, 8);
+		EXPECT_FALSE(x.uses_small_storage());
+		EXPECT_EQ(&resource, x.memory_resource());
+		EXPECT_EQ(1, resource.allocations);
+		{
+			ptr<base1> p(x);
+			EXPECT_EQ(5, p->value1);
+			val<base1> y(std::move(x));
+			EXPECT_EQ(&resource, y.memory_resource());
+			EXPECT_EQ(5, p->value1);
+			x = std::move(y);
+		}
+		EXPECT_EQ(1, resource.allocations);
+		EXPECT_EQ(1, resource.outstanding);
+	}
+	EXPECT_EQ(0, resource.outstanding);
+}
+
+TEST(ValTest, val_memory_resource_test_2) {
+	counting_resource resource;
+	{
+		auto const x = make_val<base1, derived2>(5, 6, 7, 8);
+		EXPECT_EQ(nullptr, x.memory_resource());
+		val<base1> y(std::allocator_arg, &resource, x);
+		EXPECT_EQ(&resource, y.memory_resource());
+		EXPECT_EQ(8, static_cast<derived2 const &>(*y).value4);
+		// the plain copy constructor does not propagate the resource
+		val<base1> z(y);
+		EXPECT_EQ(nullptr, z.memory_resource());
+		EXPECT_EQ(1, resource.allocations);
+	}
+	EXPECT_EQ(0, resource.outstanding);
+}
+
+TEST(ValTest, val_memory_resource_test_3) {
+	// objects that fit in small storage use neither the resource nor the heap
+	counting_resource resource;
+	test_support::allocation_scope scope;
+	{
+		auto x = allocate_val<derived2>(&resource, 5, 6, 7, 8);
+		EXPECT_TRUE(x.uses_small_storage());
+		EXPECT_EQ(nullptr, x.memory_resource());
+	}
+	EXPECT_EQ(0, resource.allocations);
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValTest, val_memory_resource_test_4) {
+	// over-aligned objects are supported by the resource path
+	counting_resource resource;
+	{
+		val<base1, 64> x(std::allocator_arg, &resource, std::in_place_type<overaligned1>);
+		EXPECT_FALSE(x.uses_small_storage());
+		EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&*x) % alignof(overaligned1));
+	}
+	EXPECT_EQ(1, resource.allocations);
+	EXPECT_EQ(0, resource.outstanding);
+}
+
+TEST(ValTest, val_visit_test_1) {
+	val<abstract1> x((concrete1()));
+	EXPECT_EQ(1337, visit<concrete1>(x, [](auto & c) { return c(); }));
+	// the visited type is the exact dynamic type
+	val<base1> const y((derived2()));
+	auto const visited = [](auto const & b) { return static_cast<int32_t>(sizeof(b)); };
+	EXPECT_EQ(static_cast<int32_t>(sizeof(derived2)), (visit<derived1, derived2>(y, visited)));
+	EXPECT_EQ(static_cast<int32_t>(sizeof(base1)), visit<derived1>(y, visited));
+	auto const value4 = [](auto const & b) -> int64_t {
+		if constexpr (std::is_same<std::decay_t<decltype(b)>, derived2>::value) {
+			return b.value4;
+		} else {
+			return -1;
+		}
+	};
+	EXPECT_EQ(4, (visit<derived1, derived2>(y, value4)));
+}
+
+TEST(ValTest, val_visit_test_2) {
+	// the base subobject is not at the start of the object
+	val<base2, 0> x(derived1(1, 5, 3));
+	visit<derived1>(x, [](auto & d) { d.value2 += 1; });
+	EXPECT_EQ(6, x->value2);
+	val_unique<base2> y(derived1(1, 7, 3));
+	int64_t value2 = 0;
+	visit<derived2, derived1>(std::move(y), [&](auto && d) { value2 = d.value2; });
+	EXPECT_EQ(7, value2);
+}
+
+TEST(ValTest, val_holds_test_1) {
+	// base1 is not polymorphic, so only the exact type is recognized
+	val<base1> const x((derived2()));
+	EXPECT_TRUE(x.holds<derived2>());
+	EXPECT_TRUE(x.holds<base1>());
+	EXPECT_FALSE(x.holds<derived1>());
+	EXPECT_EQ(nullptr, x.get_if<derived1>());
+	EXPECT_EQ(4, x.get_if<derived2>()->value4);
+	val<base2> y((derived1(1, 2, 3)));
+	y.get_if<derived1>()->value3 = 5;
+	EXPECT_EQ(5, static_cast<derived1 &>(*y).value3);
+	// base2 is not polymorphic, so the other bases of the object cannot be found
+	EXPECT_EQ(nullptr, y.get_if<base1>());
+}
+
+namespace {
+
+	struct polymorphic1 {
+		virtual ~polymorphic1() = default;
+	};
+
+	struct polymorphic2 : polymorphic1 {
+		int32_t value5 = 5;
+	};
+
+	struct polymorphic3 : base2, polymorphic2 {};
+
+}
+
+TEST(ValTest, val_holds_test_2) {
+	// bases of the dynamic type of polymorphic objects are found by dynamic_cast
+	auto const x = make_val<polymorphic1, polymorphic3>();
+	EXPECT_TRUE(x.holds<polymorphic3>());
+	EXPECT_TRUE(x.holds<polymorphic2>());
+	EXPECT_TRUE(x.holds<base2>());
+	EXPECT_EQ(5, x.get_if<polymorphic2>()->value5);
+	EXPECT_FALSE(x.holds<derived1>());
+	val_unique<polymorphic1> const y((polymorphic2()));
+	EXPECT_TRUE(y.holds<polymorphic2>());
+	EXPECT_FALSE(y.holds<polymorphic3>());
+}
+
+TEST(PtrTest, ptr_downcast_test_1) {
+	// the base2 subobject is not at the start of derived1
+	val<base2> x((derived1(1, 2, 3)));
+	ptr<derived1> y(x);
+	EXPECT_EQ(&static_cast<derived1 &>(*x), &*y);
+	EXPECT_EQ(3, y->value3);
+	ptr<base2> z(x);
+	ptr<derived1> w(z);
+	EXPECT_EQ(&*y, &*w);
+	EXPECT_THROW(ptr<derived2>{ x }, std::bad_cast);
+	EXPECT_THROW(ptr<derived2>{ z }, std::bad_cast);
+}
+
+TEST(PtrTest, ptr_downcast_test_2) {
+	val<polymorphic1> x((polymorphic3()));
+	ptr<polymorphic2> y(x);
+	EXPECT_EQ(5, y->value5);
+	ptr<polymorphic1> z(y);
+	ptr<polymorphic3> w(z);
+	EXPECT_EQ(2, w->value2);
+	EXPECT_EQ(static_cast<polymorphic2 *>(&*w), &*y);
+	val<polymorphic1> v((polymorphic2()));
+	EXPECT_THROW(ptr<polymorphic3>{ v }, std::bad_cast);
+}
+
+#if VAL_DANGLING == VAL_DANGLING_ABORT
+TEST(PtrTest, ptr_dangling_test) {
+	EXPECT_DEATH({
+		auto x = std::make_unique<val<base1>>(base1(5));
+		ptr<base1> const y(*x);
+		x.reset();
+	}, "Destruction of a val with 1 dangling ptr\\(s\\)");
+}
+#endif
+
+namespace {
+
+	struct single1 {
+		explicit single1(int32_t const value1) : value1(value1) {}
+		virtual ~single1() = default;
+		int32_t value1;
+	};
+
+	struct single2 : single1 {
+		single2(int32_t const value1, int32_t const value2) : single1(value1), value2(value2) {}
+		int32_t value2;
+	};
+
+	struct single3 : single2 {
+		single3(int32_t const value1, int32_t const value2, int32_t const value3) : single2(value1, value2), value3(value3) {}
+		int32_t value3;
+	};
+
+	// the same hierarchy, without the flag
+	struct unflagged1 : single1 {
+		using single1::single1;
+	};
+
+}
+
+template <>
+struct val_zero_upcast_offset<single1> : std::true_type {};
+
+template <>
+struct val_zero_upcast_offset<single2> : std::true_type {};
+
+static_assert(sizeof(ptr<single1>) == sizeof(void *), "a ptr to a base with a zero offset must be one word");
+static_assert(sizeof(ptr<single3>) == 2 * sizeof(void *), "a ptr to an unflagged type stores its offset");
+// small storage, the object, the op table and the block
+static_assert(sizeof(val<single1, 24>) == 24 + 3 * sizeof(void *), "a val of a base with a zero offset must not store it");
+static_assert(sizeof(val<unflagged1, 24>) > 24 + 3 * sizeof(void *), "a val of an unflagged base stores its offset");
+// small storage, the object and the op table
+static_assert(sizeof(val_unique<single1, 32>) == 32 + 2 * sizeof(void *), "a val_unique of a base with a zero offset must not store it");
+
+TEST(ValTest, val_zero_upcast_offset_test) {
+	val<single1> x(single3(1, 2, 3));
+	EXPECT_EQ(1, x->value1);
+	val<single2> y(std::in_place_type<single3>, 4, 5, 6);
+	val<single1> z(y);
+	EXPECT_EQ(5, static_cast<single2 &>(*z).value2);
+	x = y;
+	EXPECT_EQ(4, x->value1);
+	ptr<single2> p(y);
+	ptr<single1> q(p);
+	EXPECT_EQ(static_cast<single1 *>(&*y), &*q);
+	ptr<single3> r(q);
+	EXPECT_EQ(6, r->value3);
+	ptr<single2> s(r);
+	EXPECT_EQ(&*p, &*s);
+	EXPECT_TRUE(y.holds<single3>());
+	val_unique<single1> u(single2(7, 8));
+	EXPECT_EQ(7, u->value1);
+}
+
+namespace {
+
+	struct key {
+		virtual ~key() = default;
+	};
+
+	struct int_key : key {
+		static int32_t comparisons;
+		explicit int_key(int32_t const v) : v(v) {}
+		bool operator ==(int_key const & other) const { ++comparisons; return v == other.v; }
+		bool operator <(int_key const & other) const { ++comparisons; return v < other.v; }
+		int32_t v;
+	};
+
+	int32_t int_key::comparisons = 0;
+
+	struct string_key : key {
+		explicit string_key(std::string s) : s(std::move(s)) {}
+		bool operator ==(string_key const & other) const { return s == other.s; }
+		bool operator <(string_key const & other) const { return s < other.s; }
+		std::string s;
+	};
+
+	// neither hashable nor comparable
+	struct opaque_key : key {};
+
+}
+
+namespace std {
+
+	template <>
+	struct hash<int_key> {
+		size_t operator()(int_key const & k) const { return std::hash<int32_t>()(k.v); }
+	};
+
+	template <>
+	struct hash<string_key> {
+		size_t operator()(string_key const & k) const { return std::hash<std::string>()(k.s); }
+	};
+
+}
+
+TEST(ValTest, equality_test) {
+	val<key> const a(int_key(1));
+	val<key> const b(int_key(1));
+	val<key> const c(int_key(2));
+	val<key> const d(string_key("1"));
+	EXPECT_TRUE(a == b);
+	EXPECT_FALSE(a != b);
+	EXPECT_FALSE(a == c);
+	// objects of different types are unequal without calling their operator ==
+	int_key::comparisons = 0;
+	EXPECT_FALSE(a == d);
+	EXPECT_TRUE(d != a);
+	EXPECT_EQ(0, int_key::comparisons);
+	val_unique<key> const e(int_key(2));
+	EXPECT_TRUE(e == val_unique<key>(int_key(2)));
+}
+
+TEST(ValTest, ordering_test) {
+	std::map<val<key>, int32_t> m;
+	m.emplace(int_key(2), 0);
+	m.emplace(string_key("b"), 1);
+	m.emplace(int_key(1), 2);
+	m.emplace(string_key("a"), 3);
+	m.emplace(int_key(2), 4);
+	EXPECT_EQ(4u, m.size());
+	EXPECT_EQ(0, m.at(val<key>(int_key(2))));
+	EXPECT_EQ(3, m.at(val<key>(string_key("a"))));
+	val<key> const a(int_key(1));
+	val<key> const b(int_key(2));
+	EXPECT_TRUE(a < b);
+	EXPECT_TRUE(b > a);
+	EXPECT_TRUE(a <= a);
+	EXPECT_FALSE(a >= b);
+}
+
+TEST(ValTest, hash_test) {
+	std::unordered_set<val<key>> s;
+	s.insert(val<key>(int_key(1)));
+	s.insert(val<key>(string_key("1")));
+	s.insert(val<key>(int_key(1)));
+	EXPECT_EQ(2u, s.size());
+	EXPECT_EQ(1u, s.count(val<key>(string_key("1"))));
+	EXPECT_EQ(0u, s.count(val<key>(int_key(2))));
+	EXPECT_EQ(std::hash<int_key>()(int_key(3)), std::hash<val<key>>()(val<key>(int_key(3))));
+}
+
+TEST(ValTest, unsupported_comparison_test) {
+	val<key> const a((opaque_key()));
+	val<key> const b((opaque_key()));
+	EXPECT_THROW((void)(a == b), std::logic_error);
+	EXPECT_THROW((void)(a < b), std::logic_error);
+	EXPECT_THROW(a.hash(), std::logic_error);
+	// mismatched types need no operator
+	EXPECT_FALSE(a == val<key>(int_key(1)));
+}
+
+namespace {
+
+	struct opaque_element {};
+
+}
+
+// the operators of standard containers and wrappers are declared for any element, but only compile for comparable ones
+TEST(ValTest, unsupported_element_comparison_test) {
+	val<std::vector<opaque_element>> const a(std::vector<opaque_element>(1));
+	val<std::vector<opaque_element>> const b(std::vector<opaque_element>(1));
+	EXPECT_THROW((void)(a == b), std::logic_error);
+	EXPECT_THROW((void)(a < b), std::logic_error);
+	val<std::pair<int32_t, opaque_element>> const pair((std::pair<int32_t, opaque_element>()));
+	EXPECT_THROW((void)(pair == pair), std::logic_error);
+	val<std::optional<opaque_element>> const optional((std::optional<opaque_element>()));
+	EXPECT_THROW((void)(optional < optional), std::logic_error);
+	val<std::tuple<opaque_element>> const tuple((std::tuple<opaque_element>()));
+	EXPECT_THROW((void)(tuple == tuple), std::logic_error);
+	val<std::variant<int32_t, opaque_element>> const variant((std::variant<int32_t, opaque_element>()));
+	EXPECT_THROW((void)(variant == variant), std::logic_error);
+	val<std::map<int32_t, std::vector<opaque_element>>> const map((std::map<int32_t, std::vector<opaque_element>>()));
+	EXPECT_THROW((void)(map == map), std::logic_error);
+	// comparable elements are still compared
+	val<std::vector<int32_t>> const c(std::vector<int32_t>{ 1, 2 });
+	val<std::vector<int32_t>> const d(std::vector<int32_t>{ 1, 3 });
+	EXPECT_FALSE(c == d);
+	EXPECT_TRUE(c < d);
 }
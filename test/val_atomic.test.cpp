@@ -0,0 +1,96 @@
+#include "../include/val_atomic.hpp"
+#include "sample_types.hpp"
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+	using test_support::sample;
+	using test_support::counted_sample;
+
+	// consistent only if it was never observed partially constructed or destroyed
+	struct checked_sample : sample {
+		explicit checked_sample(int32_t const v) : v(v), check(~v) {}
+		~checked_sample() override { check = 0; }
+		int32_t value() const override { return check == ~v ? v : -1; }
+		int32_t v;
+		int32_t check;
+	};
+
+	typedef atomic_val<sample> sample_slot;
+
+}
+
+TEST(AtomicValTest, store_test) {
+	{
+		sample_slot slot(make_val<sample, counted_sample>(1));
+		EXPECT_EQ(1, slot.load()->value());
+		slot.store(make_val<sample, counted_sample>(2));
+		EXPECT_EQ(2, slot.load()->value());
+		EXPECT_EQ(1, counted_sample::live);
+	}
+	EXPECT_EQ(0, counted_sample::live);
+}
+
+TEST(AtomicValTest, guard_test) {
+	// a replaced object outlives the read guards that refer to it
+	sample_slot slot(make_val<sample, counted_sample>(1));
+	{
+		auto const guard = slot.load();
+		{
+			auto const nested = slot.load();
+			slot.store(make_val<sample, counted_sample>(2));
+			EXPECT_EQ(1, nested->value());
+		}
+		slot.store(make_val<sample, counted_sample>(3));
+		EXPECT_EQ(1, guard->value());
+		EXPECT_EQ(3, counted_sample::live);
+		EXPECT_EQ(3, slot.load()->value());
+	}
+	slot.reclaim();
+	EXPECT_EQ(1, counted_sample::live);
+}
+
+TEST(AtomicValTest, exchange_test) {
+	sample_slot slot(make_val<sample, counted_sample>(1));
+	val<sample> previous = slot.exchange(make_val<sample, counted_sample>(2));
+	EXPECT_EQ(1, previous->value());
+	EXPECT_EQ(2, slot.load()->value());
+	EXPECT_EQ(2, counted_sample::live);
+}
+
+TEST(AtomicValTest, concurrency_test) {
+	sample_slot slot(make_val<sample, checked_sample>(0));
+	std::atomic<bool> done{ false };
+	std::atomic<int32_t> failures{ 0 };
+	std::vector<std::thread> readers;
+	for (int32_t i = 0; i < 4; ++i) {
+		readers.emplace_back([&] {
+			int32_t last = 0;
+			while (!done.load(std::memory_order_relaxed)) {
+				auto const guard = slot.load();
+				int32_t const v = guard->value();
+				if (v < last) {
+					++failures;
+				}
+				last = v;
+			}
+		});
+	}
+	for (int32_t i = 1; i <= 2000; ++i) {
+		if (i % 100 == 0) {
+			slot.exchange(make_val<sample, checked_sample>(i));
+		} else {
+			slot.store(make_val<sample, checked_sample>(i));
+		}
+	}
+	done = true;
+	for (auto & t : readers) {
+		t.join();
+	}
+	EXPECT_EQ(0, failures);
+	EXPECT_EQ(2000, slot.load()->value());
+}
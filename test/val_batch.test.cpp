@@ -0,0 +1,110 @@
+#include "../include/val_batch.hpp"
+#include "allocation_counter.hpp"
+#include "sample_types.hpp"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+	using test_support::sample;
+	using test_support::counted_sample;
+
+	struct failing_sample : sample {
+		explicit failing_sample(int32_t const failAt) {
+			if (constructed++ == failAt) {
+				throw std::runtime_error("failing_sample");
+			}
+			++live;
+		}
+		~failing_sample() override { --live; }
+		int32_t value() const override { return 0; }
+		static int32_t constructed;
+		static int32_t live;
+	};
+
+	int32_t failing_sample::constructed = 0;
+	int32_t failing_sample::live = 0;
+
+	struct alignas(64) aligned_sample : sample {
+		int32_t value() const override { return 64; }
+	};
+
+}
+
+TEST(ValBatchTest, construct_test) {
+	{
+		test_support::allocation_scope scope;
+		auto const batch = make_vals<sample, counted_sample>(1000, 7);
+		EXPECT_EQ(1u, scope.allocations());
+		ASSERT_EQ(1000u, batch.size());
+		EXPECT_EQ(1000, counted_sample::live);
+		int32_t total = 0;
+		for (auto const & p : batch) {
+			total += p.value();
+		}
+		EXPECT_EQ(7000, total);
+	}
+	EXPECT_EQ(0, counted_sample::live);
+}
+
+TEST(ValBatchTest, ptr_test) {
+	val_batch<sample, counted_sample> batch(4, 3);
+	{
+		test_support::allocation_scope scope;
+		ptr<sample> p = batch.ptr_at(2);
+		ptr<sample> q(p);
+		EXPECT_EQ(0u, scope.allocations());
+		EXPECT_EQ(&batch[2], &*p);
+		// elements do not move with the val_batch
+		val_batch<sample, counted_sample> moved(std::move(batch));
+		EXPECT_TRUE(batch.empty());
+		EXPECT_EQ(&moved[2], &*q);
+		EXPECT_EQ(3, q->value());
+		batch = std::move(moved);
+	}
+}
+
+TEST(ValBatchTest, const_ptr_test) {
+	val_batch<sample, counted_sample> const batch(2, 4);
+	ptr<sample const> p = batch.ptr_at(1);
+	static_assert(std::is_same<sample const *, decltype(p.operator ->())>::value, "a const val_batch only gives const access");
+	EXPECT_EQ(&batch[1], &*p);
+	EXPECT_EQ(4, p->value());
+}
+
+TEST(ValBatchTest, copy_test) {
+	val_batch<sample, counted_sample> batch(3, 5);
+	val_batch<sample, counted_sample> copy(batch);
+	EXPECT_EQ(6, counted_sample::live);
+	copy[0].values[0] = 6;
+	EXPECT_EQ(5, batch[0].value());
+	EXPECT_EQ(6, copy[0].value());
+	batch = copy;
+	EXPECT_EQ(6, batch[0].value());
+	EXPECT_EQ(6, counted_sample::live);
+}
+
+TEST(ValBatchTest, exception_test) {
+	failing_sample::constructed = 0;
+	EXPECT_THROW((val_batch<sample, failing_sample>(10, 4)), std::runtime_error);
+	EXPECT_EQ(0, failing_sample::live);
+}
+
+TEST(ValBatchTest, alignment_test) {
+	val_batch<sample, aligned_sample, val_single_threaded> batch(3);
+	for (auto const & p : batch) {
+		EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&p) % alignof(aligned_sample));
+	}
+	ptr<sample, val_single_threaded> p = batch.ptr_at(1);
+	EXPECT_EQ(64, p->value());
+}
+
+TEST(ValBatchTest, empty_test) {
+	test_support::allocation_scope scope;
+	val_batch<counted_sample> batch;
+	val_batch<counted_sample> none(0, 1);
+	EXPECT_TRUE(batch.empty());
+	EXPECT_TRUE(none.empty());
+	EXPECT_EQ(batch.begin(), batch.end());
+	EXPECT_EQ(0u, scope.allocations());
+}
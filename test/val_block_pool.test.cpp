@@ -0,0 +1,82 @@
+// built as a separate executable, because VAL_BLOCK_POOL must have the same value in every translation unit
+#define VAL_BLOCK_POOL 1
+#include "../include/val_cow.hpp"
+#include "allocation_counter.hpp"
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+	struct base1 {
+		explicit base1(int32_t const value1) : value1(value1) {}
+		virtual ~base1() = default;
+		int32_t value1;
+	};
+
+	struct alignas(64) overaligned1 : base1 {
+		explicit overaligned1(int32_t const value1) : base1(value1) {}
+	};
+
+}
+
+TEST(ValBlockPoolTest, reuse_test) {
+	{
+		// fill the cache of this thread
+		val<base1> x((base1(1)));
+		ptr<base1> const y(x);
+	}
+	test_support::allocation_scope scope;
+	for (int32_t i = 0; i < 1000; ++i) {
+		val<base1> x((base1(i)));
+		EXPECT_TRUE(x.uses_small_storage());
+		ptr<base1> const y(x);
+		EXPECT_EQ(i, y->value1);
+	}
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValBlockPoolTest, cross_thread_test) {
+	// blocks created on one thread and destroyed on others are returned to the shared list in batches
+	std::vector<std::vector<val<base1>>> work(4);
+	std::vector<std::vector<ptr<base1>>> ptrs(4);
+	for (size_t t = 0; t < work.size(); ++t) {
+		work[t].reserve(1000);
+		for (int32_t i = 0; i < 1000; ++i) {
+			work[t].emplace_back(base1(i));
+			ptrs[t].emplace_back(work[t].back());
+		}
+	}
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < work.size(); ++t) {
+		threads.emplace_back([&, t] {
+			int32_t total = 0;
+			for (auto const & p : ptrs[t]) {
+				total += p->value1;
+			}
+			EXPECT_EQ(999 * 1000 / 2, total);
+			ptrs[t].clear();
+			work[t].clear();
+		});
+	}
+	for (auto & t : threads) {
+		t.join();
+	}
+	val<base1> x((base1(5)));
+	ptr<base1> const y(x);
+	EXPECT_EQ(5, y->value1);
+}
+
+TEST(ValBlockPoolTest, separate_object_test) {
+	// over-aligned heap objects are not co-located with their block
+	val<base1> x((overaligned1(6)));
+	EXPECT_FALSE(x.uses_small_storage());
+	ptr<base1> const y(x);
+	EXPECT_EQ(6, y->value1);
+	val_cow<base1, 0> z((overaligned1(7)));
+	val_cow<base1, 0> const w(z);
+	EXPECT_TRUE(z.is_shared());
+	EXPECT_EQ(7, w->value1);
+}
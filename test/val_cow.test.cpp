@@ -0,0 +1,188 @@
+#include "../include/val_cow.hpp"
+#include "allocation_counter.hpp"
+#include "sample_types.hpp"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+	using test_support::sample;
+	using test_support::small_sample;
+	using test_support::large_sample;
+	using test_support::counted_sample;
+
+	struct alignas(64) overaligned_sample : sample {
+		explicit overaligned_sample(int32_t const v) : v(v) {}
+		int32_t value() const override { return v; }
+		int32_t v;
+	};
+
+	typedef val_cow<sample, sizeof(small_sample)> sample_cow;
+
+}
+
+TEST(ValCowTest, copy_shares_test) {
+	sample_cow const x((large_sample(5)));
+	EXPECT_FALSE(x.uses_small_storage());
+	test_support::allocation_scope scope;
+	sample_cow const y(x);
+	sample_cow const z = y;
+	EXPECT_EQ(0u, scope.allocations());
+	EXPECT_EQ(&*x, &*z);
+	EXPECT_EQ(3u, x.use_count());
+	EXPECT_TRUE(y.is_shared());
+	EXPECT_EQ(5, z->value());
+}
+
+TEST(ValCowTest, write_detaches_test) {
+	sample_cow x((large_sample(5)));
+	sample_cow y(x);
+	static_cast<large_sample &>(*y).values[0] = 6;
+	EXPECT_NE(&*static_cast<sample_cow const &>(x), &*static_cast<sample_cow const &>(y));
+	EXPECT_EQ(5, x->value());
+	EXPECT_EQ(6, y->value());
+	EXPECT_FALSE(x.is_shared());
+	EXPECT_FALSE(y.is_shared());
+	// a write through an unshared val_cow does not clone
+	test_support::allocation_scope scope;
+	static_cast<large_sample &>(*x).values[0] = 7;
+	EXPECT_EQ(0u, scope.allocations());
+	EXPECT_EQ(7, x->value());
+}
+
+TEST(ValCowTest, reference_outlives_sharing_test) {
+	sample_cow a((large_sample(5)));
+	large_sample & r = static_cast<large_sample &>(*a);
+	sample_cow b = a;
+	r.values[0] = 42;
+	EXPECT_FALSE(a.is_shared());
+	EXPECT_EQ(42, static_cast<sample_cow const &>(a)->value());
+	EXPECT_EQ(5, b->value());
+	// a val_cow that was replaced shares again
+	a = sample_cow(large_sample(6));
+	sample_cow const c(a);
+	EXPECT_TRUE(c.is_shared());
+	// as does a copy, which gave out no reference
+	sample_cow const d(b);
+	EXPECT_FALSE(d.is_shared());
+	sample_cow const e(d);
+	EXPECT_TRUE(d.is_shared());
+	EXPECT_EQ(5, e->value());
+}
+
+TEST(ValCowTest, small_storage_test) {
+	// objects in small storage are copied, not shared
+	sample_cow const x((small_sample(5)));
+	EXPECT_TRUE(x.uses_small_storage());
+	test_support::allocation_scope scope;
+	sample_cow y(x);
+	EXPECT_EQ(0u, scope.allocations());
+	EXPECT_NE(&*x, &*static_cast<sample_cow const &>(y));
+	EXPECT_FALSE(y.is_shared());
+	static_cast<small_sample &>(*y).v = 6;
+	EXPECT_EQ(5, x->value());
+	EXPECT_EQ(6, y->value());
+}
+
+TEST(ValCowTest, lifetime_test) {
+	{
+		auto x = make_val_cow<sample, counted_sample>(1);
+		auto y = x;
+		sample_cow z(std::move(y));
+		EXPECT_EQ(1, counted_sample::live);
+		z->value();
+		EXPECT_EQ(2, counted_sample::live);
+		// z gave out non-const access, so x gets its own copy
+		x = z;
+		EXPECT_EQ(2, counted_sample::live);
+		x.emplace<small_sample>(3);
+		EXPECT_EQ(1, counted_sample::live);
+	}
+	EXPECT_EQ(0, counted_sample::live);
+}
+
+TEST(ValCowTest, converting_copy_test) {
+	val_cow<large_sample, 0> const x(std::in_place_type<large_sample>, 5);
+	val_cow<sample> const y(x);
+	EXPECT_EQ(&*x, &*y);
+	EXPECT_EQ(2u, y.use_count());
+	// the small object is moved into the heap, where it can be shared
+	val_cow<sample, 0> z(sample_cow(small_sample(6)));
+	EXPECT_FALSE(z.uses_small_storage());
+	typedef val_cow<sample, 0> heap_sample_cow;
+	heap_sample_cow const w(z);
+	EXPECT_EQ(&*w, &*static_cast<heap_sample_cow const &>(z));
+	EXPECT_EQ(6, w->value());
+}
+
+TEST(ValCowTest, overaligned_test) {
+	sample_cow x((overaligned_sample(5)));
+	sample_cow y(x);
+	EXPECT_TRUE(y.is_shared());
+	EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&*y) % alignof(overaligned_sample));
+	static_cast<overaligned_sample &>(*y).v = 6;
+	EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(&*static_cast<sample_cow const &>(y)) % alignof(overaligned_sample));
+	EXPECT_EQ(5, x->value());
+	EXPECT_EQ(6, y->value());
+}
+
+TEST(ValCowTest, single_threaded_test) {
+	val_cow<sample, 0, val_single_threaded> x((large_sample(5)));
+	auto y = x;
+	EXPECT_EQ(2u, x.use_count());
+	static_cast<large_sample &>(*y).values[0] = 6;
+	EXPECT_EQ(5, x->value());
+	EXPECT_EQ(6, y->value());
+}
+
+namespace {
+
+	struct set_sample {
+		void operator()(large_sample & c) const { c.values[0] = v; }
+		void operator()(sample &) const {}
+		int32_t v;
+	};
+
+}
+
+TEST(ValCowTest, visit_test) {
+	sample_cow x((large_sample(5)));
+	sample_cow y(x);
+	visit<small_sample, large_sample>(y, set_sample{ 6 });
+	EXPECT_EQ(5, x->value());
+	EXPECT_EQ(6, y->value());
+	sample_cow const & z = x;
+	EXPECT_EQ(5, visit<large_sample>(z, [](auto const & c) { return c.value(); }));
+}
+
+TEST(ValCowTest, get_if_test) {
+	sample_cow x((large_sample(5)));
+	sample_cow y(x);
+	EXPECT_EQ(nullptr, y.get_if<small_sample>());
+	EXPECT_TRUE(y.is_shared());
+	y.get_if<large_sample>()->values[0] = 6;
+	EXPECT_FALSE(y.is_shared());
+	EXPECT_EQ(5, x->value());
+	EXPECT_EQ(6, y->value());
+}
+
+namespace {
+
+	struct named_sample : sample {
+		explicit named_sample(int32_t const v) : v(v) {}
+		int32_t value() const override { return v; }
+		bool operator ==(named_sample const & other) const { return v == other.v; }
+		int32_t v;
+		int32_t padding[16] = {};
+	};
+
+}
+
+TEST(ValCowTest, equality_test) {
+	sample_cow const x((named_sample(5)));
+	sample_cow const y(x);
+	EXPECT_TRUE(x == y);
+	EXPECT_TRUE(y.is_shared());
+	EXPECT_FALSE(x == sample_cow(named_sample(6)));
+	EXPECT_FALSE(x == sample_cow(large_sample(5)));
+}
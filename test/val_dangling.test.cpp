@@ -0,0 +1,83 @@
+// the dangling ptr policy is selected at compile time, so ptrs that expire are tested in their own executable
+#define VAL_DANGLING VAL_DANGLING_EXPIRE
+
+#include "../include/val_cow.hpp"
+
+#include "gtest/gtest.h"
+
+#include <optional>
+
+namespace {
+
+	struct base1 {
+		explicit base1(int32_t const value1) : value1(value1) {}
+		virtual ~base1() = default;
+		int32_t value1;
+	};
+
+	struct large1 : base1 {
+		explicit large1(int32_t const value1) : base1(value1) {}
+		int32_t values[64] = {};
+	};
+
+	struct base2 {
+		int64_t value2 = 2;
+	};
+
+	struct derived1 : base1, base2 {
+		explicit derived1(int32_t const value1) : base1(value1) {}
+	};
+
+}
+
+static_assert(val_detail::dangling == val_detail::dangling_policy::expire);
+
+TEST(ValDanglingTest, small_storage_test) {
+	std::optional<ptr<base1>> y;
+	{
+		val<base1> x((base1(5)));
+		EXPECT_TRUE(x.uses_small_storage());
+		y.emplace(x);
+		EXPECT_FALSE(y->expired());
+		EXPECT_EQ(5, (*y)->value1);
+	}
+	EXPECT_TRUE(y->expired());
+	EXPECT_EQ(nullptr, y->operator->());
+	ptr<base1> const z(*y);
+	EXPECT_TRUE(z.expired());
+}
+
+TEST(ValDanglingTest, heap_test) {
+	// the co-located object storage is kept until the last ptr is destroyed
+	std::optional<ptr<base2>> y;
+	{
+		val<base1, 0> x((large1(5)));
+		EXPECT_FALSE(x.uses_small_storage());
+		ptr<base1> const z(x);
+		y.emplace(ptr<derived1>(val<base1, 0>(derived1(6))));
+		EXPECT_TRUE(y->expired());
+		EXPECT_FALSE(z.expired());
+	}
+	EXPECT_EQ(nullptr, y->operator->());
+}
+
+TEST(ValDanglingTest, move_test) {
+	// ptrs follow an object that is relocated, and expire when it is replaced
+	val<base1> x((base1(5)));
+	ptr<base1> const y(x);
+	val<base1> z(std::move(x));
+	EXPECT_FALSE(y.expired());
+	EXPECT_EQ(&*z, &*y);
+	z = val<base1>(base1(6));
+	EXPECT_TRUE(y.expired());
+	EXPECT_EQ(6, z->value1);
+}
+
+TEST(ValDanglingTest, single_threaded_test) {
+	std::optional<ptr<base1, val_single_threaded>> y;
+	{
+		val<base1, 16, val_single_threaded> x((base1(5)));
+		y.emplace(x);
+	}
+	EXPECT_TRUE(y->expired());
+}
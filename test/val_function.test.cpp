@@ -0,0 +1,112 @@
+#include "../include/val_function.hpp"
+#include "allocation_counter.hpp"
+
+#include "gtest/gtest.h"
+
+#include <deque>
+#include <memory>
+
+static_assert(!std::is_copy_constructible<val_function<void()>>::value, "val_function is move-only");
+static_assert(!std::is_copy_assignable<val_function<void()>>::value, "val_function is move-only");
+static_assert(std::is_nothrow_move_constructible<val_function<void()>>::value, "moving a val_function does not throw");
+static_assert(std::is_invocable<val_function<void() const> const &>::value, "a const signature can be called on a const val_function");
+static_assert(!std::is_invocable<val_function<void()> const &>::value, "a non-const signature cannot be called on a const val_function");
+
+TEST(ValFunctionTest, call_test) {
+	val_function<int32_t(int32_t, int32_t)> add([](int32_t const a, int32_t const b) { return a + b; });
+	EXPECT_EQ(5, add(2, 3));
+	int32_t calls = 0;
+	val_function<void()> count([&calls] { ++calls; });
+	count();
+	count();
+	EXPECT_EQ(2, calls);
+	// the result is converted to the declared return type, or discarded
+	val_function<int64_t(int32_t)> widen([](int32_t const a) { return a; });
+	EXPECT_EQ(7, widen(7));
+	val_function<void(int32_t)> discard([](int32_t const a) { return a; });
+	discard(1);
+}
+
+int32_t twice(int32_t const a) {
+	return 2 * a;
+}
+
+TEST(ValFunctionTest, function_pointer_test) {
+	val_function<int32_t(int32_t)> f(&twice);
+	EXPECT_EQ(8, f(4));
+	f = val_function<int32_t(int32_t)>([](int32_t const a) { return a + 1; });
+	EXPECT_EQ(5, f(4));
+}
+
+TEST(ValFunctionTest, move_only_test) {
+	auto buffer = std::make_unique<int32_t>(5);
+	val_function<int32_t()> f([b = std::move(buffer)] { return *b; });
+	EXPECT_EQ(5, f());
+	val_function<int32_t()> g(std::move(f));
+	EXPECT_EQ(5, g());
+	// arguments are forwarded, so move-only arguments are passed through
+	val_function<int32_t(std::unique_ptr<int32_t>)> consume([](std::unique_ptr<int32_t> p) { return *p; });
+	EXPECT_EQ(6, consume(std::make_unique<int32_t>(6)));
+}
+
+TEST(ValFunctionTest, small_storage_test) {
+	std::deque<val_function<void(), 16>> queue;
+	queue.emplace_back([] {});
+	int32_t total = 0;
+	test_support::allocation_scope scope;
+	for (int32_t i = 0; i < 16; ++i) {
+		val_function<void(), 16> task([i, &total] { total += i; });
+		EXPECT_TRUE(task.uses_small_storage());
+		queue.front() = std::move(task);
+		queue.front()();
+	}
+	EXPECT_EQ(0u, scope.allocations());
+	EXPECT_EQ(120, total);
+	// larger callables go on the heap
+	int64_t big[4] = { 1, 2, 3, 4 };
+	val_function<int64_t(), 16> sum([big] { return big[0] + big[1] + big[2] + big[3]; });
+	EXPECT_FALSE(sum.uses_small_storage());
+	EXPECT_EQ(10, sum());
+}
+
+TEST(ValFunctionTest, mutable_test) {
+	val_function<int32_t()> counter([n = 0]() mutable { return ++n; });
+	counter();
+	EXPECT_EQ(2, counter());
+}
+
+TEST(ValFunctionTest, const_test) {
+	val_function<int32_t(int32_t) const> offset([base = 10](int32_t const a) { return base + a; });
+	auto const & view = offset;
+	EXPECT_EQ(13, view(3));
+	val_function<int32_t(int32_t) const> const moved(std::move(offset));
+	EXPECT_EQ(14, moved(4));
+}
+
+TEST(ValFunctionTest, empty_test) {
+	val_function<void()> f([] {});
+	EXPECT_TRUE(static_cast<bool>(f));
+	val_function<void()> g(std::move(f));
+	EXPECT_FALSE(static_cast<bool>(f)); // NOLINT(bugprone-use-after-move, hicpp-invalid-access-moved)
+	EXPECT_TRUE(static_cast<bool>(g));
+	f = std::move(g);
+	EXPECT_TRUE(static_cast<bool>(f));
+}
+
+TEST(ValFunctionTest, default_constructor_test) {
+	val_function<int32_t()> f;
+	EXPECT_FALSE(static_cast<bool>(f));
+	EXPECT_TRUE(f.empty());
+	f = [] { return 3; };
+	EXPECT_TRUE(static_cast<bool>(f));
+	EXPECT_EQ(3, f());
+}
+
+TEST(ValFunctionTest, nullptr_constructor_test) {
+	val_function<int32_t()> f(nullptr);
+	EXPECT_FALSE(static_cast<bool>(f));
+	EXPECT_TRUE(f.empty());
+	val_function<int32_t()> g([] { return 4; });
+	g = nullptr;
+	EXPECT_FALSE(static_cast<bool>(g));
+}
@@ -0,0 +1,128 @@
+#include "../include/val_iface.hpp"
+#include "allocation_counter.hpp"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+	// message structs with no common base and no virtual functions
+	struct ping {
+		int32_t sequence;
+		int32_t size() const { return 4; }
+		void bump(int32_t const by) { sequence += by; }
+	};
+
+	struct payload {
+		int32_t bytes[32];
+		int32_t size() const { return static_cast<int32_t>(sizeof(bytes)); }
+		void bump(int32_t const by) { bytes[0] += by; }
+	};
+
+	// counts live instances
+	struct text {
+		static int32_t live;
+		explicit text(std::string s) : s(std::move(s)) { ++live; }
+		text(text const & other) : s(other.s) { ++live; }
+		text(text && other) noexcept : s(std::move(other.s)) { ++live; }
+		~text() { --live; }
+		int32_t size() const { return static_cast<int32_t>(s.size()); }
+		void bump(int32_t const by) { s.append(static_cast<size_t>(by), '!'); }
+		std::string s;
+	};
+
+	int32_t text::live = 0;
+
+	struct message_interface {
+		typedef val_iface_signatures<int32_t() const, void(int32_t)> signatures;
+
+		template <typename T>
+		static constexpr auto functions = std::make_tuple(
+			[](T const & t) { return t.size(); },
+			[](T & t, int32_t const by) { t.bump(by); });
+
+		template <typename Self>
+		struct members {
+			int32_t size() const { return val_iface_call<0>(*this); }
+			void bump(int32_t const by) { val_iface_call<1>(*this, by); }
+		};
+	};
+
+	typedef val_iface<message_interface> message;
+
+}
+
+static_assert(sizeof(message) == 16 + 2 * sizeof(void *), "a val_iface is its small storage, the object and one table");
+
+TEST(ValIfaceTest, call_test) {
+	std::vector<message> messages;
+	messages.emplace_back(ping{ 1 });
+	messages.emplace_back(payload{});
+	messages.emplace_back(text("hello"));
+	EXPECT_EQ(4, messages[0].size());
+	EXPECT_EQ(128, messages[1].size());
+	EXPECT_EQ(5, messages[2].size());
+	messages[0].bump(2);
+	messages[2].bump(2);
+	EXPECT_EQ(3, messages[0].get_if<ping>()->sequence);
+	EXPECT_EQ(7, messages[2].size());
+}
+
+TEST(ValIfaceTest, storage_test) {
+	test_support::allocation_scope scope;
+	message const m(ping{ 1 });
+	EXPECT_TRUE(m.uses_small_storage());
+	EXPECT_EQ(0u, scope.allocations());
+	message const n((payload()));
+	EXPECT_FALSE(n.uses_small_storage());
+	EXPECT_EQ(typeid(payload), n.type());
+}
+
+TEST(ValIfaceTest, copy_test) {
+	{
+		message m(text("a"));
+		message n(m);
+		n.bump(1);
+		EXPECT_EQ(1, m.size());
+		EXPECT_EQ(2, n.size());
+		EXPECT_EQ(2, text::live);
+		message p(std::move(n));
+		EXPECT_EQ(2, p.size());
+		m = p;
+		EXPECT_EQ(2, m.size());
+		m = message(ping{ 5 });
+		EXPECT_EQ(1, text::live);
+		EXPECT_EQ(nullptr, m.get_if<text>());
+		EXPECT_EQ(5, m.get_if<ping>()->sequence);
+		m.emplace<text>("abc");
+		EXPECT_EQ(3, m.size());
+	}
+	EXPECT_EQ(0, text::live);
+}
+
+TEST(ValIfaceTest, heap_copy_test) {
+	payload big{};
+	big.bytes[0] = 3;
+	message const m(big);
+	message n(m);
+	n.bump(1);
+	EXPECT_EQ(3, m.get_if<payload>()->bytes[0]);
+	EXPECT_EQ(4, n.get_if<payload>()->bytes[0]);
+	message const p(std::move(n));
+	EXPECT_EQ(4, p.get_if<payload>()->bytes[0]);
+}
+
+TEST(ValIfaceTest, empty_test) {
+	message const m;
+	EXPECT_TRUE(m.empty());
+	EXPECT_EQ(nullptr, m.get_if<ping>());
+	// copying an empty val_iface copies nothing
+	message n(m);
+	EXPECT_TRUE(n.empty());
+	n = ping{ 2 };
+	EXPECT_FALSE(n.empty());
+	n = m;
+	EXPECT_TRUE(n.empty());
+}
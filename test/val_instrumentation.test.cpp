@@ -0,0 +1,163 @@
+// built as a separate executable, because VAL_INSTRUMENTATION must have the same value in every translation unit
+#define VAL_INSTRUMENTATION 1
+#include "../include/val.hpp"
+
+#include "gtest/gtest.h"
+
+#include <sstream>
+
+using val_instrumentation::event;
+
+namespace {
+
+	struct base1 {
+		base1() : value1(1) {}
+		virtual ~base1() = default;
+		int32_t value1;
+	};
+
+	struct small1 : base1 {
+		int32_t value2 = 2;
+	};
+
+	struct large1 : base1 {
+		int32_t values[16] = {};
+	};
+
+	struct throwing_move1 : base1 {
+		throwing_move1() = default;
+		throwing_move1(throwing_move1 const &) = default;
+		throwing_move1(throwing_move1 &&) noexcept(false) {}
+	};
+
+	struct alignas(64) aligned1 : base1 {
+		int32_t value2 = 2;
+	};
+
+	// a base whose hint aligns small storage for aligned2
+	struct aligned_base1 {
+		virtual ~aligned_base1() = default;
+	};
+
+	struct alignas(64) aligned2 : aligned_base1 {
+		int32_t value1 = 1;
+	};
+
+}
+
+template <>
+struct val_storage_hint<aligned_base1> {
+	static constexpr size_t size = 8;
+	static constexpr size_t alignment = 64;
+};
+
+namespace {
+
+	class InstrumentationTest : public ::testing::Test {
+	protected:
+		void SetUp() override {
+			val_instrumentation::reset();
+		}
+
+		void TearDown() override {
+			val_instrumentation::set_hook(nullptr);
+		}
+	};
+
+	uint64_t fallbacks_of(std::type_info const & u, size_t smallStorageSize) {
+		uint64_t result = 0;
+		val_instrumentation::for_each_fallback([&](val_instrumentation::event_info const & info, uint64_t count) {
+			if (*info.u == u && info.small_storage_size == smallStorageSize) {
+				result += count;
+			}
+		});
+		return result;
+	}
+
+	size_t required_size_of(std::type_info const & u) {
+		size_t result = 1;
+		val_instrumentation::for_each_fallback([&](val_instrumentation::event_info const & info, uint64_t) {
+			if (*info.u == u) {
+				result = val_instrumentation::required_small_storage_size(info);
+			}
+		});
+		return result;
+	}
+
+	size_t hook_calls;
+	event last_event;
+
+	void counting_hook(event e, val_instrumentation::event_info const &) {
+		++hook_calls;
+		last_event = e;
+	}
+
+}
+
+static_assert(val_instrumentation::enabled);
+
+TEST_F(InstrumentationTest, small_storage_hit) {
+	val<base1, sizeof(small1)> x((small1()));
+	EXPECT_EQ(1u, val_instrumentation::count(event::small_storage_hit));
+	EXPECT_EQ(0u, val_instrumentation::count(event::heap_fallback));
+}
+
+TEST_F(InstrumentationTest, heap_fallback) {
+	val<base1, sizeof(small1)> x((large1()));
+	val<base1, sizeof(small1)> y((large1()));
+	val_unique<base1, sizeof(small1)> z((large1()));
+	EXPECT_EQ(3u, val_instrumentation::count(event::heap_fallback));
+	EXPECT_EQ(3u, fallbacks_of(typeid(large1), sizeof(small1)));
+	EXPECT_EQ(0u, fallbacks_of(typeid(large1), sizeof(large1)));
+}
+
+TEST_F(InstrumentationTest, clone) {
+	val<base1, sizeof(small1)> const x((small1()));
+	val<base1, sizeof(small1)> y(x);
+	auto const z = x.clone();
+	EXPECT_EQ(2u, val_instrumentation::count(event::clone));
+	EXPECT_EQ(2u, val_instrumentation::count(event::small_storage_hit));
+}
+
+TEST_F(InstrumentationTest, ptr_references) {
+	val<base1> x((small1()));
+	{
+		ptr<base1> p(x);
+		ptr<base1> q(p);
+		EXPECT_EQ(2u, val_instrumentation::count(event::ptr_increment));
+	}
+	EXPECT_EQ(2u, val_instrumentation::count(event::ptr_decrement));
+}
+
+TEST_F(InstrumentationTest, hook) {
+	hook_calls = 0;
+	val_instrumentation::set_hook(&counting_hook);
+	val<base1, sizeof(small1)> x((large1()));
+	EXPECT_EQ(1u, hook_calls);
+	EXPECT_EQ(event::heap_fallback, last_event);
+}
+
+TEST_F(InstrumentationTest, dump) {
+	{
+		val<base1, sizeof(small1)> x((large1()));
+		val<base1, sizeof(small1)> y((throwing_move1()));
+	}
+	std::ostringstream os;
+	val_instrumentation::dump(os);
+	std::string const text = os.str();
+	EXPECT_NE(std::string::npos, text.find("val heap fallbacks: 2"));
+	EXPECT_NE(std::string::npos, text.find("SmallStorageSize " + std::to_string(sizeof(large1)) + " avoids 1"));
+	EXPECT_NE(std::string::npos, text.find("cannot use small storage"));
+}
+
+TEST_F(InstrumentationTest, required_small_storage_size) {
+	val<base1, sizeof(small1)> x((large1()));
+	// more aligned than small storage, so no size would hold it
+	val<base1, sizeof(small1)> y((aligned1()));
+	// its base raises the alignment of small storage, so only the size is missing
+	val<aligned_base1> z((aligned2()));
+	EXPECT_FALSE(z.uses_small_storage());
+	EXPECT_EQ(sizeof(large1), required_size_of(typeid(large1)));
+	EXPECT_EQ(0u, required_size_of(typeid(aligned1)));
+	EXPECT_EQ(sizeof(aligned2), required_size_of(typeid(aligned2)));
+}
@@ -0,0 +1,94 @@
+#include "../include/val_move_only.hpp"
+
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <vector>
+
+namespace {
+
+	struct resource {
+		virtual ~resource() = default;
+		virtual int32_t value() const = 0;
+	};
+
+	// holds a unique_ptr, so it cannot be copied
+	struct owned_resource : resource {
+		explicit owned_resource(int32_t const v) : v(std::make_unique<int32_t>(v)) {}
+		int32_t value() const override { return *v; }
+		std::unique_ptr<int32_t> v;
+	};
+
+	struct large_owned_resource : owned_resource {
+		explicit large_owned_resource(int32_t const v) : owned_resource(v) {}
+		int64_t padding[16] = {};
+	};
+
+	struct base2 {
+		virtual ~base2() = default;
+		int64_t value2 = 2;
+	};
+
+	// the resource subobject is not at offset zero
+	struct offset_resource : base2, owned_resource {
+		explicit offset_resource(int32_t const v) : owned_resource(v) {}
+	};
+
+	typedef val_move_only<resource, sizeof(owned_resource)> resource_val;
+
+	template <typename V, typename = void>
+	struct has_clone : std::false_type {};
+
+	template <typename V>
+	struct has_clone<V, std::void_t<decltype(std::declval<V const &>().clone())>> : std::true_type {};
+
+}
+
+static_assert(!std::is_copy_constructible<resource_val>::value, "val_move_only is not copyable");
+static_assert(!std::is_copy_assignable<resource_val>::value, "val_move_only is not copyable");
+static_assert(std::is_nothrow_move_constructible<resource_val>::value, "moving a val_move_only does not throw");
+static_assert(!has_clone<resource_val>::value, "val_move_only cannot be cloned");
+static_assert(has_clone<val_unique<resource>>::value, "val_unique can be cloned");
+static_assert(!std::is_constructible<resource_val, val_unique<resource, sizeof(owned_resource)> const &>::value, "val_move_only cannot be copied from val_unique");
+static_assert(std::is_constructible<resource_val, val_unique<resource, sizeof(owned_resource)> &&>::value, "val_unique can be moved into val_move_only");
+static_assert(!std::is_constructible<val_unique<resource>, val_move_only<resource> &&>::value, "val_move_only cannot be moved into val_unique");
+static_assert(!std::is_assignable<val_unique<resource> &, val_move_only<resource> &&>::value, "val_move_only cannot be moved into val_unique");
+
+TEST(ValMoveOnlyTest, construct_test) {
+	resource_val const x((owned_resource(1)));
+	EXPECT_TRUE(x.uses_small_storage());
+	EXPECT_EQ(1, x->value());
+	resource_val const y(std::in_place_type<large_owned_resource>, 2);
+	EXPECT_FALSE(y.uses_small_storage());
+	EXPECT_EQ(2, y->value());
+	auto const z = make_val_move_only<resource, offset_resource>(3);
+	EXPECT_EQ(3, z->value());
+}
+
+TEST(ValMoveOnlyTest, move_test) {
+	std::vector<resource_val> v;
+	for (int32_t i = 0; i < 8; ++i) {
+		if (i % 2 == 0) {
+			v.emplace_back(owned_resource(i));
+		} else {
+			v.emplace_back(std::in_place_type<large_owned_resource>, i);
+		}
+	}
+	for (int32_t i = 0; i < 8; ++i) {
+		EXPECT_EQ(i, v[static_cast<size_t>(i)]->value());
+	}
+	resource_val x(std::move(v[1]));
+	v[0] = std::move(x);
+	EXPECT_EQ(1, v[0]->value());
+	v[0].emplace<offset_resource>(9);
+	EXPECT_EQ(9, v[0]->value());
+	EXPECT_TRUE(v[0].holds<offset_resource>());
+}
+
+TEST(ValMoveOnlyTest, converting_move_test) {
+	val_move_only<owned_resource, sizeof(owned_resource)> x((owned_resource(4)));
+	// moved into a val_move_only without small storage, so it is relocated to the heap
+	val_move_only<resource, 0> y(std::move(x));
+	EXPECT_FALSE(y.uses_small_storage());
+	EXPECT_EQ(4, y->value());
+}
@@ -0,0 +1,119 @@
+#include "../include/val_parallel.hpp"
+#include "allocation_counter.hpp"
+#include "sample_types.hpp"
+
+#include "gtest/gtest.h"
+
+namespace {
+
+	using test_support::sample;
+	using test_support::small_sample;
+	using test_support::counted_sample;
+
+	// throws when copied from the sample with the value fail
+	struct failing_sample : counted_sample {
+		static int32_t fail;
+		explicit failing_sample(int32_t const v) : counted_sample(v) {}
+		failing_sample(failing_sample const & other) : counted_sample(other) {
+			if (other.value() == fail) {
+				throw std::runtime_error("failing_sample");
+			}
+		}
+	};
+
+	int32_t failing_sample::fail = -1;
+
+	typedef val<sample, sizeof(small_sample)> sample_val;
+
+	// uninitialized storage for count sample_vals
+	class sample_storage {
+	public:
+		explicit sample_storage(size_t const count) : memory(std::allocator<sample_val>().allocate(count)), count(count) {}
+		sample_storage(sample_storage const &) = delete;
+		sample_storage& operator =(sample_storage const &) = delete;
+		~sample_storage() { std::allocator<sample_val>().deallocate(memory, count); }
+		sample_val * data() const { return memory; }
+
+	private:
+		sample_val * memory;
+		size_t count;
+	};
+
+	std::vector<sample_val> make_samples(size_t const count) {
+		std::vector<sample_val> result;
+		result.reserve(count);
+		for (size_t i = 0; i < count; ++i) {
+			if (i % 2 == 0) {
+				result.emplace_back(std::in_place_type<small_sample>, static_cast<int32_t>(i));
+			} else {
+				result.emplace_back(std::in_place_type<counted_sample>, static_cast<int32_t>(i));
+			}
+		}
+		return result;
+	}
+
+}
+
+TEST(ValParallelTest, clone_range_test) {
+	{
+		auto const source = make_samples(4000);
+		sample_storage copies(source.size());
+		val_clone_range(source.begin(), source.end(), copies.data(), val_thread_executor(4));
+		EXPECT_EQ(4000, counted_sample::live);
+		for (size_t i = 0; i < source.size(); ++i) {
+			ASSERT_EQ(static_cast<int32_t>(i), copies.data()[i]->value());
+			EXPECT_NE(&*source[i], &*copies.data()[i]);
+		}
+		val_destroy_range(copies.data(), copies.data() + source.size(), val_thread_executor(4));
+		EXPECT_EQ(2000, counted_sample::live);
+	}
+	EXPECT_EQ(0, counted_sample::live);
+}
+
+TEST(ValParallelTest, serial_executor_test) {
+	auto const source = make_samples(10);
+	sample_storage copies(source.size());
+	val_clone_range(source.begin(), source.end(), copies.data(), val_serial_executor());
+	EXPECT_EQ(9, copies.data()[9]->value());
+	val_destroy_range(copies.data(), copies.data() + source.size(), val_serial_executor());
+}
+
+TEST(ValParallelTest, arenas_test) {
+	auto const source = make_samples(4000);
+	{
+		val_clone_arenas arenas;
+		sample_storage copies(source.size());
+		{
+			test_support::allocation_scope scope;
+			val_clone_range(source.begin(), source.end(), copies.data(), arenas, val_thread_executor(4));
+			// each task makes one allocation for its arena, and may need a second for the arena's bookkeeping
+			EXPECT_EQ(4u, arenas.size());
+			EXPECT_GE(2 * arenas.size() + 10, scope.allocations());
+		}
+		for (size_t i = 0; i < source.size(); ++i) {
+			ASSERT_EQ(static_cast<int32_t>(i), copies.data()[i]->value());
+		}
+		EXPECT_EQ(nullptr, copies.data()[0].memory_resource());
+		EXPECT_NE(nullptr, copies.data()[1].memory_resource());
+		{
+			// ptrs to the copies use the blocks in the arenas
+			ptr<sample> const p(copies.data()[1]);
+			EXPECT_EQ(1, p->value());
+		}
+		val_destroy_range(copies.data(), copies.data() + source.size(), val_thread_executor(4));
+	}
+	EXPECT_EQ(2000, counted_sample::live);
+}
+
+TEST(ValParallelTest, exception_test) {
+	auto source = make_samples(4000);
+	source[2001].emplace<failing_sample>(2001);
+	failing_sample::fail = 2001;
+	sample_storage copies(source.size());
+	EXPECT_THROW(val_clone_range(source.begin(), source.end(), copies.data(), val_thread_executor(4)), std::runtime_error);
+	EXPECT_EQ(2000, counted_sample::live);
+	val_clone_arenas arenas;
+	EXPECT_THROW(val_clone_range(source.begin(), source.end(), copies.data(), arenas, val_thread_executor(4)), std::runtime_error);
+	EXPECT_EQ(2000, counted_sample::live);
+	failing_sample::fail = -1;
+}
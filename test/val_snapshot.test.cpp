@@ -0,0 +1,171 @@
+#include "../include/val_snapshot.hpp"
+#include "allocation_counter.hpp"
+
+#include "gtest/gtest.h"
+
+#include <cstdio>
+#include <string>
+
+namespace {
+
+	// trivially copyable messages that share a header
+	struct message {
+		int32_t kind;
+	};
+
+	struct position : message {
+		position(float const x, float const y) : message{ 1 }, x(x), y(y) {}
+		float x;
+		float y;
+	};
+
+	struct velocity : message {
+		velocity(double const dx, double const dy, double const dz) : message{ 2 }, dx(dx), dy(dy), dz(dz) {}
+		double dx;
+		double dy;
+		double dz;
+	};
+
+	struct unregistered : message {
+		unregistered() : message{ 3 } {}
+	};
+
+	std::string snapshot_path(char const * name) {
+		return testing::TempDir() + name;
+	}
+
+	val_vector<message> make_messages(int32_t const count) {
+		val_vector<message> v;
+		for (int32_t i = 0; i < count; ++i) {
+			if (i % 3 == 0) {
+				v.emplace_back<velocity>(i, i + 1, i + 2);
+			} else {
+				v.emplace_back<position>(static_cast<float>(i), static_cast<float>(-i));
+			}
+		}
+		return v;
+	}
+
+	// overwrite a field of the header of the snapshot file at path
+	void corrupt_header(std::string const & path, uint64_t val_detail::snapshot_header::* field, uint64_t const value) {
+		std::FILE * const file = std::fopen(path.c_str(), "r+b");
+		ASSERT_NE(nullptr, file);
+		val_detail::snapshot_header header{};
+		ASSERT_EQ(1u, std::fread(&header, sizeof(header), 1, file));
+		header.*field = value;
+		std::fseek(file, 0, SEEK_SET);
+		ASSERT_EQ(1u, std::fwrite(&header, sizeof(header), 1, file));
+		std::fclose(file);
+	}
+
+	// overwrite a field of the first entry of the snapshot file at path
+	void corrupt_first_entry(std::string const & path, uint64_t val_detail::snapshot_entry::* field, uint64_t const value) {
+		std::FILE * const file = std::fopen(path.c_str(), "r+b");
+		ASSERT_NE(nullptr, file);
+		val_detail::snapshot_header header{};
+		val_detail::snapshot_entry entry{};
+		ASSERT_EQ(1u, std::fread(&header, sizeof(header), 1, file));
+		std::fseek(file, static_cast<long>(header.entries_offset), SEEK_SET);
+		ASSERT_EQ(1u, std::fread(&entry, sizeof(entry), 1, file));
+		entry.*field = value;
+		std::fseek(file, static_cast<long>(header.entries_offset), SEEK_SET);
+		ASSERT_EQ(1u, std::fwrite(&entry, sizeof(entry), 1, file));
+		std::fclose(file);
+	}
+
+}
+
+template <>
+struct val_type_id<position> : std::integral_constant<uint64_t, 10> {};
+
+template <>
+struct val_type_id<velocity> : std::integral_constant<uint64_t, 11> {};
+
+TEST(ValSnapshotTest, round_trip_test) {
+	auto const path = snapshot_path("val_snapshot_round_trip");
+	auto const v = make_messages(1000);
+	save_val_snapshot<position, velocity>(v, path.c_str());
+	{
+		test_support::allocation_scope scope;
+		auto s = load_val_snapshot<message, velocity, position>(path.c_str());
+		// only the op tables of the types in the file are collected, not one allocation per element
+		EXPECT_GE(2u, scope.allocations());
+		ASSERT_EQ(v.size(), s.size());
+		EXPECT_EQ(v.arena_size(), s.arena_size());
+		for (size_t i = 0; i < v.size(); ++i) {
+			ASSERT_EQ(v.type(i), s.type(i));
+			ASSERT_EQ(v[i].kind, s[i].kind);
+		}
+		EXPECT_FLOAT_EQ(-4.0f, static_cast<position const &>(s[4]).y);
+		EXPECT_DOUBLE_EQ(5.0, static_cast<velocity const &>(s[3]).dz);
+		size_t positions = 0;
+		for (auto const & m : s) {
+			positions += m.kind == 1 ? 1 : 0;
+		}
+		EXPECT_EQ(666u, positions);
+		// writes change this mapping, not the file
+		s[0].kind = 7;
+	}
+	auto const reloaded = load_val_snapshot<message, position, velocity>(path.c_str());
+	EXPECT_EQ(2, reloaded[0].kind);
+	std::remove(path.c_str());
+}
+
+TEST(ValSnapshotTest, to_vector_test) {
+	auto const path = snapshot_path("val_snapshot_to_vector");
+	save_val_snapshot<position, velocity>(make_messages(10), path.c_str());
+	auto v = load_val_snapshot<message, position, velocity>(path.c_str()).to_vector();
+	v.emplace_back<position>(1.0f, 2.0f);
+	ASSERT_EQ(11u, v.size());
+	EXPECT_EQ(typeid(velocity), v.type(9));
+	EXPECT_DOUBLE_EQ(11.0, static_cast<velocity const &>(v[9]).dz);
+	EXPECT_EQ(1, v.back().kind);
+	std::remove(path.c_str());
+}
+
+TEST(ValSnapshotTest, empty_test) {
+	auto const path = snapshot_path("val_snapshot_empty");
+	save_val_snapshot<position>(val_vector<message>(), path.c_str());
+	auto const s = load_val_snapshot<message, position>(path.c_str());
+	EXPECT_TRUE(s.empty());
+	EXPECT_EQ(s.begin(), s.end());
+	std::remove(path.c_str());
+}
+
+TEST(ValSnapshotTest, error_test) {
+	auto const path = snapshot_path("val_snapshot_error");
+	val_vector<message> v;
+	v.emplace_back<unregistered>();
+	EXPECT_THROW(save_val_snapshot<position>(v, path.c_str()), std::invalid_argument);
+	save_val_snapshot<position, velocity>(make_messages(3), path.c_str());
+	// a type in the file that the loader does not register
+	EXPECT_THROW((load_val_snapshot<message, position>(path.c_str())), std::invalid_argument);
+	// entries that lie outside the arena, even when the sum of the offset and the size overflows
+	corrupt_first_entry(path, &val_detail::snapshot_entry::object_offset, uint64_t(1) << 40);
+	EXPECT_THROW((load_val_snapshot<message, position, velocity>(path.c_str())), std::runtime_error);
+	corrupt_first_entry(path, &val_detail::snapshot_entry::object_offset, ~uint64_t(0) - 7);
+	EXPECT_THROW((load_val_snapshot<message, position, velocity>(path.c_str())), std::runtime_error);
+	// the first element is a velocity, which is aligned to 8
+	corrupt_first_entry(path, &val_detail::snapshot_entry::object_offset, 4);
+	EXPECT_THROW((load_val_snapshot<message, position, velocity>(path.c_str())), std::runtime_error);
+	// a message that is not the message of its object
+	corrupt_first_entry(path, &val_detail::snapshot_entry::object_offset, 0);
+	corrupt_first_entry(path, &val_detail::snapshot_entry::value_offset, 8);
+	EXPECT_THROW((load_val_snapshot<message, position, velocity>(path.c_str())), std::runtime_error);
+	corrupt_first_entry(path, &val_detail::snapshot_entry::value_offset, 0);
+	EXPECT_EQ(2, (load_val_snapshot<message, position, velocity>(path.c_str())[0].kind));
+	// an arena whose offset and size wrap around when added
+	corrupt_header(path, &val_detail::snapshot_header::arena_size, 64);
+	corrupt_header(path, &val_detail::snapshot_header::arena_offset, ~uint64_t(0) - 63);
+	EXPECT_THROW((load_val_snapshot<message, position, velocity>(path.c_str())), std::runtime_error);
+	// more entries than fit before the arena, with a size that overflows
+	save_val_snapshot<position, velocity>(make_messages(3), path.c_str());
+	corrupt_header(path, &val_detail::snapshot_header::count, uint64_t(1) << 60);
+	EXPECT_THROW((load_val_snapshot<message, position, velocity>(path.c_str())), std::runtime_error);
+	std::FILE * const file = std::fopen(path.c_str(), "wb");
+	std::fputs("not a snapshot", file);
+	std::fclose(file);
+	EXPECT_THROW((load_val_snapshot<message, position>(path.c_str())), std::runtime_error);
+	std::remove(path.c_str());
+	EXPECT_THROW((load_val_snapshot<message, position>(path.c_str())), std::system_error);
+}
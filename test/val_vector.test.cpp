@@ -0,0 +1,248 @@
+#include "../include/val_vector.hpp"
+#include "allocation_counter.hpp"
+
+#include "gtest/gtest.h"
+
+#include <numeric>
+
+namespace {
+
+	struct shape {
+		explicit shape(int32_t const id) : id(id) {}
+		virtual ~shape() = default;
+		virtual int32_t area() const = 0;
+		int32_t id;
+	};
+
+	struct square : shape {
+		square(int32_t const id, int32_t const side) : shape(id), side(side) {}
+		int32_t area() const override { return side * side; }
+		int32_t side;
+	};
+
+	struct rectangle : shape {
+		rectangle(int32_t const id, int32_t const width, int64_t const height) : shape(id), width(width), height(height) {}
+		int32_t area() const override { return width * static_cast<int32_t>(height); }
+		int32_t width;
+		int64_t height;
+	};
+
+	struct tagged {
+		int8_t tag = 7;
+	};
+
+	// the shape subobject is not at offset zero
+	struct tagged_square : tagged, square {
+		tagged_square(int32_t const id, int32_t const side) : square(id, side) {}
+	};
+
+}
+
+TEST(ValVectorTest, emplace_back_test) {
+	val_vector<shape> v;
+	v.emplace_back<square>(0, 2);
+	v.emplace_back<rectangle>(1, 2, 3);
+	v.push_back(tagged_square(2, 4));
+	ASSERT_EQ(3u, v.size());
+	EXPECT_EQ(4, v[0].area());
+	EXPECT_EQ(6, v[1].area());
+	EXPECT_EQ(16, v[2].area());
+	EXPECT_EQ(7, dynamic_cast<tagged_square &>(v[2]).tag);
+	EXPECT_EQ(typeid(rectangle), v.type(1));
+}
+
+TEST(ValVectorTest, contiguous_test) {
+	val_vector<shape> v;
+	for (int32_t i = 0; i < 100; ++i) {
+		if (i % 2 == 0) {
+			v.emplace_back<square>(i, i);
+		} else {
+			v.emplace_back<rectangle>(i, i, 2);
+		}
+	}
+	// elements are in increasing address order within a single arena
+	auto const first = reinterpret_cast<int8_t const *>(&v.front());
+	for (size_t i = 1; i < v.size(); ++i) {
+		EXPECT_LT(reinterpret_cast<int8_t const *>(&v[i - 1]), reinterpret_cast<int8_t const *>(&v[i]));
+		EXPECT_LT(reinterpret_cast<int8_t const *>(&v[i]), first + v.arena_size());
+		EXPECT_EQ(static_cast<int32_t>(i), v[i].id);
+	}
+	EXPECT_LE(v.arena_size(), 50 * (sizeof(square) + sizeof(rectangle)));
+}
+
+TEST(ValVectorTest, iteration_test) {
+	val_vector<shape> v;
+	v.emplace_back<square>(0, 1);
+	v.emplace_back<rectangle>(1, 2, 3);
+	v.emplace_back<tagged_square>(2, 3);
+	int32_t total = 0;
+	for (auto const & s : v) {
+		total += s.area();
+	}
+	EXPECT_EQ(1 + 6 + 9, total);
+	EXPECT_EQ(3, std::distance(v.begin(), v.end()));
+	val_vector<shape>::const_iterator i = v.begin();
+	EXPECT_EQ(6, (i + 1)->area());
+	EXPECT_EQ(9, i[2].area());
+}
+
+TEST(ValVectorTest, allocation_test) {
+	val_vector<shape> v;
+	v.reserve(64, 64 * sizeof(rectangle));
+	test_support::allocation_scope scope;
+	for (int32_t i = 0; i < 64; ++i) {
+		v.emplace_back<rectangle>(i, 1, 1);
+	}
+	EXPECT_EQ(0u, scope.allocations());
+}
+
+TEST(ValVectorTest, copy_test) {
+	val_vector<shape> v;
+	v.emplace_back<square>(0, 2);
+	v.emplace_back<tagged_square>(1, 3);
+	val_vector<shape> w(v);
+	v.pop_back();
+	EXPECT_EQ(1u, v.size());
+	ASSERT_EQ(2u, w.size());
+	EXPECT_EQ(9, w[1].area());
+	EXPECT_NE(&v[0], &w[0]);
+	val_vector<shape> x(std::move(w));
+	EXPECT_TRUE(w.empty());
+	EXPECT_EQ(9, x.back().area());
+	v = x;
+	EXPECT_EQ(2u, v.size());
+	EXPECT_EQ(4, v.front().area());
+}
+
+TEST(ValVectorTest, self_reference_test) {
+	// the argument refers to an element that is relocated by growth
+	val_vector<shape> v;
+	v.emplace_back<square>(0, 5);
+	for (int i = 0; i < 10; ++i) {
+		v.push_back(static_cast<square const &>(v[0]));
+	}
+	for (auto const & s : v) {
+		EXPECT_EQ(25, s.area());
+	}
+}
+
+namespace {
+
+	// vtable pointers are position independent, so these shapes are trivially relocatable
+	struct relocatable_square : square {
+		using square::square;
+	};
+
+	struct relocatable_rectangle : rectangle {
+		using rectangle::rectangle;
+	};
+
+	// refers to itself, so it must be moved through its move constructor
+	struct self_square : square {
+		self_square(int32_t const id, int32_t const side) : square(id, side), self(this) {}
+		self_square(self_square const & other) : square(other), self(this) {}
+		self_square(self_square && other) noexcept : square(other), self(this) {}
+		int32_t area() const override { return self == this ? side * side : -1; }
+		self_square const * self;
+	};
+
+}
+
+template <>
+struct val_is_trivially_relocatable<relocatable_square> : std::true_type {};
+
+template <>
+struct val_is_trivially_relocatable<relocatable_rectangle> : std::true_type {};
+
+TEST(ValVectorTest, relocatable_growth_test) {
+	val_vector<shape> v;
+	for (int32_t i = 0; i < 100; ++i) {
+		if (i % 2 == 0) {
+			v.emplace_back<relocatable_square>(i, i);
+		} else {
+			v.emplace_back<relocatable_rectangle>(i, i, 2);
+		}
+	}
+	for (int32_t i = 0; i < 100; ++i) {
+		EXPECT_EQ(i, v[i].id);
+		EXPECT_EQ(i % 2 == 0 ? i * i : i * 2, v[i].area());
+	}
+}
+
+TEST(ValVectorTest, mixed_growth_test) {
+	val_vector<shape> v;
+	for (int32_t i = 0; i < 100; ++i) {
+		if (i % 2 == 0) {
+			v.emplace_back<relocatable_square>(i, i);
+		} else {
+			v.emplace_back<self_square>(i, i);
+		}
+	}
+	for (int32_t i = 0; i < 100; ++i) {
+		EXPECT_EQ(i * i, v[i].area());
+	}
+}
+
+TEST(ValVectorTest, erase_test_1) {
+	// every element is trivially relocatable, so the tail is shifted in one block
+	val_vector<shape> v;
+	for (int32_t i = 0; i < 10; ++i) {
+		v.emplace_back<relocatable_rectangle>(i, i, 1);
+	}
+	size_t const before = v.arena_size();
+	auto const next = v.erase(v.begin() + 2, v.begin() + 5);
+	EXPECT_EQ(5, next->id);
+	ASSERT_EQ(7u, v.size());
+	EXPECT_LT(v.arena_size(), before);
+	int32_t const expected[] = { 0, 1, 5, 6, 7, 8, 9 };
+	for (size_t i = 0; i < v.size(); ++i) {
+		EXPECT_EQ(expected[i], v[i].id);
+		EXPECT_EQ(expected[i], v[i].area());
+	}
+	v.emplace_back<relocatable_rectangle>(10, 10, 1);
+	EXPECT_EQ(10, v.back().area());
+}
+
+TEST(ValVectorTest, erase_test_2) {
+	// elements that are not trivially relocatable are moved through the op table
+	val_vector<shape> v;
+	for (int32_t i = 0; i < 10; ++i) {
+		if (i % 3 == 0) {
+			v.emplace_back<self_square>(i, i);
+		} else {
+			v.emplace_back<relocatable_square>(i, i);
+		}
+	}
+	v.erase(v.begin());
+	v.erase(v.begin() + 3, v.end() - 1);
+	ASSERT_EQ(4u, v.size());
+	int32_t const expected[] = { 1, 2, 3, 9 };
+	for (size_t i = 0; i < v.size(); ++i) {
+		EXPECT_EQ(expected[i], v[i].id);
+		EXPECT_EQ(expected[i] * expected[i], v[i].area());
+	}
+	val_vector<shape> w(v);
+	EXPECT_EQ(81, w.back().area());
+	v.erase(v.begin(), v.end());
+	EXPECT_TRUE(v.empty());
+	EXPECT_EQ(0u, v.arena_size());
+}
+
+TEST(ValVectorTest, parallel_copy_test) {
+	val_vector<shape> v;
+	for (int32_t i = 0; i < 2000; ++i) {
+		if (i % 2 == 0) {
+			v.emplace_back<square>(i, i);
+		} else {
+			v.emplace_back<tagged_square>(i, i);
+		}
+	}
+	val_vector<shape> const w(v, val_thread_executor(4));
+	ASSERT_EQ(v.size(), w.size());
+	EXPECT_EQ(v.arena_size(), w.arena_size());
+	for (size_t i = 0; i < v.size(); ++i) {
+		ASSERT_EQ(v[i].id, w[i].id);
+		EXPECT_EQ(v[i].area(), w[i].area());
+		EXPECT_NE(&v[i], &w[i]);
+	}
+}